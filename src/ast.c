@@ -0,0 +1,519 @@
+#include "common.c"
+
+//
+// FLAT AST
+//
+// Same tree as DtNode, but every node is an index into a set of dense
+// arrays. Children of a node are stored next to each other, so n-th
+// child is first_child + n and walking them is a linear scan. Block of
+// children is placed right before subtrees of those children, which
+// keeps subtrees close together too.
+//
+// There are no pointers inside, text of identifiers is copied into
+// `strings` and addressed by offset, so whole thing can be moved or
+// written out as is. Included at the end of parser.c.
+//
+#ifndef __DT_AST_H
+#define __DT_AST_H
+
+typedef unsigned int dt_node;
+
+#define DT_AST_NONE ((dt_node) -1)
+#define DT_AST_ROOT ((dt_node)  0)
+
+#ifndef DT_AST_INITIAL_CAPACITY
+#	define DT_AST_INITIAL_CAPACITY 256
+#endif
+
+// where in the source node comes from
+typedef struct {
+    unsigned int    offset;
+    unsigned int    length;
+} DtAstSpan;
+
+typedef struct {
+    char*           items;
+    size_t          count;
+    size_t          capacity;
+} DtAstStrings;
+
+typedef struct {
+    size_t          count;
+    size_t          capacity;
+
+    unsigned char*  kinds;          // DtNodeKind
+    unsigned short* properties;     // NKP_*
+    unsigned int*   first_child;    // children are [first_child, first_child + child_count)
+    unsigned int*   child_count;
+    Token*          identifiers;    // kind, id and value of literals
+    unsigned int*   text;           // offset in `strings`, DT_AST_NONE if there is no text
+    DtAstSpan*      spans;          // side table, only needed for errors
+
+    DtAstStrings    strings;
+} DtAst;
+
+void __dta_reserve(DtAst* a, size_t count) {
+    if (a->count + count <= a->capacity) return;
+    size_t capacity = a->capacity ? a->capacity : DT_AST_INITIAL_CAPACITY;
+    while(capacity < a->count + count) capacity *= 2;
+
+    a->kinds        = realloc(a->kinds,       capacity * sizeof(*a->kinds));
+    a->properties   = realloc(a->properties,  capacity * sizeof(*a->properties));
+    a->first_child  = realloc(a->first_child, capacity * sizeof(*a->first_child));
+    a->child_count  = realloc(a->child_count, capacity * sizeof(*a->child_count));
+    a->identifiers  = realloc(a->identifiers, capacity * sizeof(*a->identifiers));
+    a->text         = realloc(a->text,        capacity * sizeof(*a->text));
+    a->spans        = realloc(a->spans,       capacity * sizeof(*a->spans));
+    assert(a->kinds && a->properties && a->first_child && a->child_count &&
+           a->identifiers && a->text && a->spans && "Failed to grow AST");
+    a->capacity = capacity;
+}
+
+unsigned int __dta_put_string(DtAst* a, const char* text, size_t length) {
+    DtAstStrings* s = &a->strings;
+    if (s->count + length + 1 > s->capacity) {
+        size_t capacity = s->capacity ? s->capacity : DT_AST_INITIAL_CAPACITY;
+        while(capacity < s->count + length + 1) capacity *= 2;
+        s->items    = realloc(s->items, capacity);
+        s->capacity = capacity;
+        assert(s->items && "Failed to grow AST strings");
+    }
+    const unsigned int offset = s->count;
+    memcpy(s->items + offset, text, length);
+    s->items[offset + length] = 0;
+    s->count += length + 1;
+    return offset;
+}
+
+// interned words share one copy of text, keyed by symbol id
+typedef struct {
+    unsigned int*   items; // 1 + offset in strings, 0 if not placed yet
+    size_t          count;
+} __DtaSymbolStrings;
+
+void __dta_set_node(DtAst* a, __DtaSymbolStrings* symbols, dt_node n, const DtNode* node) {
+    const Token id = node->identifier;
+    a->kinds[n]       = node->kind;
+    a->properties[n]  = node->properties;
+    a->first_child[n] = DT_AST_NONE;
+    a->child_count[n] = 0;
+    a->identifiers[n] = id;
+    a->spans[n]       = (DtAstSpan) {
+        .offset = node->source_location.offset,
+        .length = node->text ? node->identifier.length : 0,
+    };
+
+    if (!node->text) {
+        a->text[n] = DT_AST_NONE;
+        return;
+    }
+    if (!(id.flags & TokenFlag_symbol)) {
+        a->text[n] = __dta_put_string(a, node->text, id.length);
+        return;
+    }
+
+    if (id.aux >= symbols->count) {
+        size_t count = symbols->count ? symbols->count : DT_AST_INITIAL_CAPACITY;
+        while(count <= id.aux) count *= 2;
+        symbols->items = realloc(symbols->items, count * sizeof(*symbols->items));
+        memset(symbols->items + symbols->count, 0, (count - symbols->count) * sizeof(*symbols->items));
+        symbols->count = count;
+    }
+    if (!symbols->items[id.aux])
+        symbols->items[id.aux] = 1 + __dta_put_string(a, node->text, id.length);
+    a->text[n] = symbols->items[id.aux] - 1;
+}
+
+void __dta_place_children(DtAst* a, __DtaSymbolStrings* symbols, dt_node self, const DtNode* node) {
+    size_t count = 0;
+    for(const DtNode* it = node->children; it; it = it->next) count++;
+    if (!count) return;
+
+    __dta_reserve(a, count);
+    const dt_node first = a->count;
+    a->count += count;
+    a->first_child[self] = first;
+    a->child_count[self] = count;
+
+    dt_node n = first;
+    for(const DtNode* it = node->children; it; it = it->next)
+        __dta_set_node(a, symbols, n++, it);
+
+    n = first;
+    for(const DtNode* it = node->children; it; it = it->next)
+        __dta_place_children(a, symbols, n++, it);
+}
+
+// copy tree into flat form, `root` becomes DT_AST_ROOT.
+// Lazy blocks (NKP_IS_LAZY) stay empty, see dtp_block_parse
+DtAst dta_from_tree(const DtNode* root) {
+    DtAst a = {0};
+    if (!root) return a;
+    __DtaSymbolStrings symbols = {0};
+
+    __dta_reserve(&a, 1);
+    a.count = 1;
+    __dta_set_node(&a, &symbols, DT_AST_ROOT, root);
+    __dta_place_children(&a, &symbols, DT_AST_ROOT, root);
+
+    free(symbols.items);
+    return a;
+}
+
+void dta_free(DtAst* a) {
+    free(a->kinds);
+    free(a->properties);
+    free(a->first_child);
+    free(a->child_count);
+    free(a->identifiers);
+    free(a->text);
+    free(a->spans);
+    free(a->strings.items);
+    *a = (DtAst) {0};
+}
+
+//
+// ACCESS
+//
+
+static inline DtNodeKind dta_kind(const DtAst* a, dt_node n) {
+    return (DtNodeKind) a->kinds[n];
+}
+
+static inline size_t dta_child_count(const DtAst* a, dt_node n) {
+    return a->child_count[n];
+}
+
+// n-th child or DT_AST_NONE, O(1) unlike dtp_node_index
+static inline dt_node dta_child(const DtAst* a, dt_node n, size_t i) {
+    return (i < a->child_count[n]) ? a->first_child[n] + i : DT_AST_NONE;
+}
+
+Slice dta_text(const DtAst* a, dt_node n) {
+    Slice s = {0};
+    if (a->text[n] == DT_AST_NONE) return s;
+    s.data   = a->strings.items + a->text[n];
+    s.length = a->identifiers[n].length;
+    return s;
+}
+
+// first node of `kind` in subtree of `n` (`n` included), depth first
+dt_node dta_find(const DtAst* a, dt_node n, DtNodeKind kind) {
+    if (n == DT_AST_NONE) return DT_AST_NONE;
+    if (a->kinds[n] == kind) return n;
+    for(size_t i = 0; i < a->child_count[n]; i++) {
+        const dt_node child = a->first_child[n] + i;
+        if (a->kinds[child] == kind) return child;
+        const dt_node found = dta_find(a, child, kind);
+        if (found != DT_AST_NONE) return found;
+    }
+    return DT_AST_NONE;
+}
+
+// same output as dtp_print_ast
+void dta_print(const DtAst* a, dt_node n, int depth, FILE* output_redir) {
+    if (n == DT_AST_NONE || n >= a->count) return;
+    char  temp[TOKENIZER_TEMP_CSTR_CAPACITY];
+    Slice text = dta_text(a, n);
+
+    fprintf(output_redir,
+            "%*s%s: "
+            "%c%s\t\n",
+            depth*4, "",
+            DT_NODE_KIND_STR[a->kinds[n]],
+            (a->properties[n] & NKP_HAS_UNARY) ? '-' : ' ',
+            __tkn_temp_cstr(
+                a->identifiers[n],
+                (TknSlice) { text.data, text.length },
+                TokenizerPrintFlag_display_text,
+                temp, sizeof(temp))
+    );
+    for(size_t i = 0; i < a->child_count[n]; i++)
+        dta_print(a, a->first_child[n] + i, depth + 1, output_redir);
+}
+
+// tree for the evaluator, built from flat form without lexer or source.
+// Text points into `a`, so it has to outlive the tree
+DtNode* __dta_node_to_tree(const DtAst* a, dt_node n, Arena* nodes) {
+    DtNode* node = arena_alloc(nodes, sizeof(DtNode));
+    Slice   text = dta_text(a, n);
+    node->kind            = a->kinds[n];
+    node->properties      = a->properties[n];
+    node->identifier      = a->identifiers[n];
+    node->text            = text.data;
+    node->source_location = a->identifiers[n];
+    node->source_location.offset = a->spans[n].offset;
+
+    for(size_t i = 0; i < a->child_count[n]; i++)
+        dtp_node_append(node, __dta_node_to_tree(a, a->first_child[n] + i, nodes));
+    return node;
+}
+
+DtNode* dta_to_tree(const DtAst* a, Arena* nodes) {
+    return a->count ? __dta_node_to_tree(a, DT_AST_ROOT, nodes) : NULL;
+}
+
+//
+// IMAGE
+//
+// Flat AST and symbol table written to disk as they are in memory, every
+// array is addressed by offset from the start of the file. Image is
+// loaded with one mmap and used in place. It is keyed by hash of source
+// it was parsed from, so a stale image is never used. Images are only
+// read by the same build that wrote them (native endianness and sizes).
+//
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#define DT_AST_IMAGE_MAGIC      "DTASTIMG"
+#define DT_AST_IMAGE_VERSION    1
+#define DT_AST_IMAGE_ALIGN      16
+
+// interned word, text is offset in image's symbol text
+typedef struct {
+    unsigned int    text;
+    unsigned int    length;
+    unsigned int    hash;
+} DtAstSymbol;
+
+typedef struct {
+    unsigned long long offset;
+    unsigned long long size;
+} DtAstSection;
+
+typedef enum {
+    DT_AST_SECTION_KINDS,
+    DT_AST_SECTION_PROPERTIES,
+    DT_AST_SECTION_FIRST_CHILD,
+    DT_AST_SECTION_CHILD_COUNT,
+    DT_AST_SECTION_IDENTIFIERS,
+    DT_AST_SECTION_TEXT,
+    DT_AST_SECTION_SPANS,
+    DT_AST_SECTION_STRINGS,
+    DT_AST_SECTION_SYMBOLS,
+    DT_AST_SECTION_SYMBOL_TEXT,
+    DT_AST_SECTION_COUNT,
+} DtAstSectionId;
+
+typedef struct {
+    char                magic[8];
+    unsigned int        version;
+    unsigned int        token_size;     // layout check, see Token
+    unsigned long long  source_hash;
+    unsigned long long  source_length;
+    unsigned long long  node_count;
+    unsigned long long  symbol_count;
+    DtAstSection        sections[DT_AST_SECTION_COUNT];
+} DtAstImageHeader;
+
+typedef struct {
+    DtAst               ast;        // arrays point into mapping
+    const DtAstSymbol*  symbols;    // index is symbol id
+    size_t              symbol_count;
+    const char*         symbol_text;
+    size_t              symbol_text_size;
+
+    void*               data;
+    size_t              size;
+} DtAstImage;
+
+// FNV-1a over the whole input, key of the image
+unsigned long long dta_source_hash(const char* source, size_t length) {
+    unsigned long long h = 14695981039346656037ull;
+    loop(i, length) {
+        h ^= (unsigned char) source[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+bool __dta_write_section(FILE* f, DtAstImageHeader* h, DtAstSectionId id, const void* data, size_t size) {
+    static const char zeros[DT_AST_IMAGE_ALIGN];
+    long at = ftell(f);
+    if (at < 0) return false;
+    const size_t pad = (DT_AST_IMAGE_ALIGN - at % DT_AST_IMAGE_ALIGN) % DT_AST_IMAGE_ALIGN;
+    if (fwrite(zeros, 1, pad, f) != pad) return false;
+
+    h->sections[id] = (DtAstSection) { at + pad, size };
+    return size == 0 || fwrite(data, 1, size, f) == size;
+}
+
+// write image of `a` with symbols of tokenizer that parsed `source`.
+// File is written next to `path` and renamed over it, so readers
+// never see half of it
+bool dta_image_write(const char* path, const DtAst* a, const TokenSymbols* symbols, 
+                     const char* source, size_t length) {
+    char temp[4096];
+    if (snprintf(temp, sizeof(temp), "%s.tmp", path) >= (int) sizeof(temp)) return false;
+    FILE* f = fopen(temp, "wb");
+    if (!f) return false;
+
+    DtAstImageHeader h = {
+        .magic          = DT_AST_IMAGE_MAGIC,
+        .version        = DT_AST_IMAGE_VERSION,
+        .token_size     = sizeof(Token),
+        .source_hash    = dta_source_hash(source, length),
+        .source_length  = length,
+        .node_count     = a->count,
+        .symbol_count   = symbols ? symbols->count : 0,
+    };
+
+    DtAstStrings text  = {0};
+    DtAstSymbol* table = calloc(h.symbol_count + 1, sizeof(DtAstSymbol));
+    assert(table && "Failed to allocate symbol table");
+    loop(i, h.symbol_count) {
+        const TokenSymbol* it = &symbols->items[i];
+        table[i] = (DtAstSymbol) {
+            .text   = text.count,
+            .length = it->length,
+            .hash   = it->hash,
+        };
+        if (text.count + it->length + 1 > text.capacity) {
+            text.capacity = (text.count + it->length + 1) * 2;
+            text.items    = realloc(text.items, text.capacity);
+            assert(text.items && "Failed to grow symbol text");
+        }
+        memcpy(text.items + text.count, it->text, it->length);
+        text.items[text.count + it->length] = 0;
+        text.count += it->length + 1;
+    }
+
+    const size_t n = a->count;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+        __dta_write_section(f, &h, DT_AST_SECTION_KINDS,       a->kinds,       n * sizeof(*a->kinds)) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_PROPERTIES,  a->properties,  n * sizeof(*a->properties)) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_FIRST_CHILD, a->first_child, n * sizeof(*a->first_child)) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_CHILD_COUNT, a->child_count, n * sizeof(*a->child_count)) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_IDENTIFIERS, a->identifiers, n * sizeof(*a->identifiers)) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_TEXT,        a->text,        n * sizeof(*a->text)) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_SPANS,       a->spans,       n * sizeof(*a->spans)) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_STRINGS,     a->strings.items, a->strings.count) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_SYMBOLS,     table,          h.symbol_count * sizeof(*table)) &&
+        __dta_write_section(f, &h, DT_AST_SECTION_SYMBOL_TEXT, text.items,     text.count) &&
+        fseek(f, 0, SEEK_SET) == 0 &&
+        fwrite(&h, sizeof(h), 1, f) == 1;
+
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && rename(temp, path) == 0;
+    if (!ok) remove(temp);
+    free(table);
+    free(text.items);
+    return ok;
+}
+
+// everything loaded tree is built from points inside of the image:
+// children come after their parent and inside of node arrays, so walking
+// them ends, and text of nodes and symbols is inside of its section
+bool __dta_image_valid(const DtAstImage* image) {
+    const DtAst* a = &image->ast;
+    const size_t strings = a->strings.count;
+    if (a->count == 0) return false;
+    loop(n, a->count) {
+        if (a->kinds[n] >= DT_ARRLEN(DT_NODE_KIND_STR)) return false;
+        const size_t first = a->first_child[n];
+        const size_t count = a->child_count[n];
+        if (count && (first <= n || first > a->count || count > a->count - first)) return false;
+
+        const size_t text   = a->text[n];
+        const size_t length = a->identifiers[n].length;
+        if (a->text[n] != DT_AST_NONE && (text > strings || length > strings - text)) return false;
+    }
+    loop(i, image->symbol_count) {
+        const size_t text   = image->symbols[i].text;
+        const size_t length = image->symbols[i].length;
+        if (text > image->symbol_text_size || length > image->symbol_text_size - text) return false;
+    }
+    return true;
+}
+
+// map image, fails if there is none, it is broken or it was made from
+// other source. Nothing in it is changed, arrays are used where they are
+bool dta_image_load(DtAstImage* image, const char* path, const char* source, size_t length) {
+    *image = (DtAstImage) {0};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    void* data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(DtAstImageHeader))
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    const size_t size = st.st_size;
+    const DtAstImageHeader* h = data;
+
+    // no section is bigger than the file, counts past it are broken and
+    // would overflow sizes below
+    bool ok = 
+        h->node_count   <= size &&
+        h->symbol_count <= size &&
+        memcmp(h->magic, DT_AST_IMAGE_MAGIC, sizeof(h->magic)) == 0 &&
+        h->version       == DT_AST_IMAGE_VERSION &&
+        h->token_size    == sizeof(Token) &&
+        h->source_length == length &&
+        h->source_hash   == dta_source_hash(source, length);
+
+    // sizes are checked too, so broken image can not point out of mapping
+    const size_t n = h->node_count;
+    const size_t expected[DT_AST_SECTION_COUNT] = {
+        [DT_AST_SECTION_KINDS]          = n * sizeof(*image->ast.kinds),
+        [DT_AST_SECTION_PROPERTIES]     = n * sizeof(*image->ast.properties),
+        [DT_AST_SECTION_FIRST_CHILD]    = n * sizeof(*image->ast.first_child),
+        [DT_AST_SECTION_CHILD_COUNT]    = n * sizeof(*image->ast.child_count),
+        [DT_AST_SECTION_IDENTIFIERS]    = n * sizeof(*image->ast.identifiers),
+        [DT_AST_SECTION_TEXT]           = n * sizeof(*image->ast.text),
+        [DT_AST_SECTION_SPANS]          = n * sizeof(*image->ast.spans),
+        [DT_AST_SECTION_SYMBOLS]        = h->symbol_count * sizeof(DtAstSymbol),
+    };
+    loop(i, DT_AST_SECTION_COUNT) {
+        const DtAstSection s = h->sections[i];
+        ok = ok && s.offset % DT_AST_IMAGE_ALIGN == 0 && s.offset <= size && s.size <= size - s.offset;
+        ok = ok && (i == DT_AST_SECTION_STRINGS || i == DT_AST_SECTION_SYMBOL_TEXT || s.size == expected[i]);
+    }
+    if (!ok) {
+        munmap(data, size);
+        return false;
+    }
+
+#define SECTION(ID) ((void*)((char*) data + h->sections[ID].offset))
+    image->ast = (DtAst) {
+        .count          = n,
+        .capacity       = n,
+        .kinds          = SECTION(DT_AST_SECTION_KINDS),
+        .properties     = SECTION(DT_AST_SECTION_PROPERTIES),
+        .first_child    = SECTION(DT_AST_SECTION_FIRST_CHILD),
+        .child_count    = SECTION(DT_AST_SECTION_CHILD_COUNT),
+        .identifiers    = SECTION(DT_AST_SECTION_IDENTIFIERS),
+        .text           = SECTION(DT_AST_SECTION_TEXT),
+        .spans          = SECTION(DT_AST_SECTION_SPANS),
+        .strings        = { 
+            .items      = SECTION(DT_AST_SECTION_STRINGS),
+            .count      = h->sections[DT_AST_SECTION_STRINGS].size,
+        },
+    };
+    image->symbols      = SECTION(DT_AST_SECTION_SYMBOLS);
+    image->symbol_count = h->symbol_count;
+    image->symbol_text  = SECTION(DT_AST_SECTION_SYMBOL_TEXT);
+    image->symbol_text_size = h->sections[DT_AST_SECTION_SYMBOL_TEXT].size;
+#undef SECTION
+    image->data = data;
+    image->size = size;
+    if (!__dta_image_valid(image)) {
+        munmap(data, size);
+        *image = (DtAstImage) {0};
+        return false;
+    }
+    return true;
+}
+
+void dta_image_close(DtAstImage* image) {
+    if (image->data) munmap(image->data, image->size);
+    *image = (DtAstImage) {0};
+}
+
+#endif // _WIN32
+
+#endif // __DT_AST_H
@@ -150,15 +150,16 @@ void sb_append_first_str(StringBuilder* sb, int marker, char* string) {
 
 #define SB_TEMP_BUFFER_SIZE 4096
 
+// temp is on the stack, so builders on different threads do not clash
 #define sb_append_first(sb, ...) do {\
-    static char temp[SB_TEMP_BUFFER_SIZE];\
-    sprintf(temp, __VA_ARGS__);\
+    char temp[SB_TEMP_BUFFER_SIZE];\
+    snprintf(temp, SB_TEMP_BUFFER_SIZE, __VA_ARGS__);\
     sb_append_first_str(sb, 0, temp); \
 } while(0)
 
 #define sb_append(sb, ...) do {\
-    static char temp[SB_TEMP_BUFFER_SIZE];\
-    sprintf(temp, __VA_ARGS__);\
+    char temp[SB_TEMP_BUFFER_SIZE];\
+    snprintf(temp, SB_TEMP_BUFFER_SIZE, __VA_ARGS__);\
     sb_append_one(sb, 0, temp); \
 } while(0)
 
@@ -228,6 +229,7 @@ typedef struct ArenaNode {
 typedef struct {
     size_t      totally_allocated;
     ArenaNode*  memory;
+    ArenaNode*  tail; // node allocations go to, last in `memory`
 } Arena;
 
 ArenaNode* arena_make_node(void) {
@@ -237,14 +239,10 @@ ArenaNode* arena_make_node(void) {
 void* arena_alloc(Arena* a, size_t size) {
     assert(ARENA_NODE_SIZE > size);
     void* ret = 0;
-    ArenaNode* tail = a->memory;
     
-    if (!a->memory) {
-        a->memory = arena_make_node();
-        tail = a->memory;
-        goto arena_alloc_goto;
-    }
-    while(tail->next) tail = tail->next;
+    if (!a->memory) 
+        a->memory = a->tail = arena_make_node();
+    ArenaNode* tail = a->tail;
 
 arena_alloc_goto:
     if (tail->allocated + size < (ARENA_NODE_SIZE - ARENA_HEADER_SIZE)) {
@@ -252,7 +250,7 @@ arena_alloc_goto:
         tail->allocated += size;
     } else {
         tail->next = arena_make_node();
-        tail = tail->next;
+        tail = a->tail = tail->next;
         goto arena_alloc_goto;
     }
 
@@ -268,6 +266,19 @@ void arena_reset(Arena* a) {
         node = node->next;
         free(to_free);
     }
+    a->memory = a->tail = NULL;
+}
+
+// move all memory of `from` to the end of `into`, `from` is left empty
+void arena_merge(Arena* into, Arena* from) {
+    if (!from->memory) return;
+    if (into->memory) 
+        into->tail->next = from->memory;
+    else 
+        into->memory = from->memory;
+    into->tail = from->tail;
+    into->totally_allocated += from->totally_allocated;
+    *from = (Arena) {0};
 }
 
 void arena_clear(Arena* a) {
@@ -382,7 +393,7 @@ float map_load(Map m) {
 }
 
 Map map_alloc(Map* m, size_t cap) {
-    static Map local_map;
+    Map local_map = {0};
 
     if(!m) m = &local_map;
     
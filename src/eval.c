@@ -8,11 +8,16 @@
 
 
 DtObject dte_eval_function(DtContext* ctx, DtNode* node);
+DtObject dte_eval_call(DtContext* ctx, DtNode* node);
+const DtFunc* __dte_eval_args(DtContext* ctx, DtNode* node, bool tail);
+size_t dte_resolve_function(DtNode* decl, DtScope* functions);
 
-DtIdentifer dte_ident_from_token(Token t) {
+DtIdentifer dte_ident_from_node(DtNode* node) {
+    Slice text = dtp_node_text(node);
     DtIdentifer ident = {
-        .name   = t.data.as_word.data,
-        .length = t.data.as_word.length,
+        .name   = text.data,
+        .length = text.length,
+        .id     = dtp_node_symbol(node),
     };
     return ident;
 }
@@ -31,44 +36,92 @@ DtObject dte_object_from_numeric_literall(DtNode* node) {
             return dto_object_from_numeric(
                     dto_ident(""), 
                     DT_TYPE_BOOL, 
-                    node->identifier.data.as_int);
-        case NK_INTLIT:
+                    node->identifier.id == TI_KW_TRUE);
+        case NK_INTLIT: {
+            // literals past int range keep all 64 bits
+            const long long value = Token_int(node->identifier);
             return dto_object_from_numeric(
                     dto_ident(""), 
-                    DT_TYPE_INT, 
-                    node->identifier.data.as_int);
+                    (value > INT_MAX || value < INT_MIN) ? DT_TYPE_LONG : DT_TYPE_INT, 
+                    value);
+        }
         case NK_FLTLIT:
+            // literal is decoded as double, keep all of it
             return dto_object_from_numeric(
                     dto_ident(""), 
-                    DT_TYPE_FLOAT, 
-                    dto_numeric_from_float(node->identifier.data.as_float));
+                    DT_TYPE_DOUBLE, 
+                    dto_numeric_from_double(Token_float(node->identifier)));
         default: assert(0 && "Expected numeric AST node");
     }
 }
 
 DtIdentifer dte_ident_from_id(Arena* a, int n) {
-    DtIdentifer ident;
-    static char temp[1024];
-    sprintf(temp, "$%i", n);
+    DtIdentifer ident = {0};
+    char temp[32];
+    snprintf(temp, sizeof(temp), "$%i", n);
     const char* id = arena_put_string(a, temp); 
     ident.name   = id;
     ident.length = strlen(id);
-    memset(temp, 0, sizeof(temp));
     return ident;
 }
 
-DtObject* dte_lookup_object(DtContext* ctx, DtIdentifer ident) {
-    //DtScopeList top = ctx->sfs[ctx->call_depth-1].scopes;
-    DtScope* current = ctx->current;
-    DtObject* result = 0;
-    DtObject* it = dto_scope_ref(current, ident);
-    (void) result;
-    return it;
+// name of object field, unnamed ones are named by their position
+DtIdentifer dte_field_ident(Arena* a, DtNode* field, int id) {
+    if (field->kind == NK_VARIABLE) return dte_ident_from_node(field);
+    return dte_ident_from_id(a, id);
+}
+
+// same interned symbol, or same text when either is not interned
+bool dte_same_ident(DtIdentifer a, DtIdentifer b) {
+    if (a.id && b.id) return a.id == b.id;
+    return a.length == b.length && memcmp(a.name, b.name, a.length) == 0;
+}
+
+// function called by `call`, looked up only when it was cached from
+// other table or this one changed since. Pointer is into `functions`.
+// Table that is cleared and used again should be left to
+// dte_eval_prepass, dto_scope_init in its place would count from 0
+const DtFunc* dte_callee(DtScope* functions, DtNode* call) {
+    if (call->callee_table == functions && call->callee_version == functions->version)
+        return call->callee;
+    DtObject* func = dto_scope_ref(functions, dte_ident_from_node(call));
+    if (!func || func->value.type != DT_TYPE_FUNCTION) return NULL;
+    call->callee         = &func->value.as_function;
+    call->callee_table   = functions;
+    call->callee_version = functions->version;
+    return call->callee;
 }
 
+// call whose value `ret` gives as it is, so it is the last thing
+// function does and can run in frame of it
+DtNode* dte_tail_call(DtNode* ret) {
+    const int prefix = NKP_HAS_UNARY | NKP_HAS_NOT;
+    DtNode* value = ret->children;
+    while(value && value->kind == NK_EXPRESSION && !(value->properties & prefix))
+        value = value->children;
+    if (!value || value->kind != NK_FUNCTION_CALL || (value->properties & prefix)) return NULL;
+    return value;
+}
+
+// local of running function, see dte_resolve_function
+DtObject* dte_lookup_slot(DtContext* ctx, DtNode* node) {
+    assert(node->slot && "Unknown variable");
+    return &ctx->slots[node->slot - 1];
+}
 
-//TODO: handle unary
+
+DtObject dte_eval_operation(DtContext* ctx, DtNode* node);
+
+// value of node with its prefix operators applied
 DtObject dte_eval_expression(DtContext* ctx, DtNode* node) {
+    if(!node) return DT_OBJECT_NULL;
+    DtObject v = dte_eval_operation(ctx, node);
+    if (node->properties & NKP_HAS_UNARY) v = dto_object_unary(v, DT_UNARY_NEG);
+    if (node->properties & NKP_HAS_NOT)   v = dto_object_unary(v, DT_UNARY_NOT);
+    return v;
+}
+
+DtObject dte_eval_operation(DtContext* ctx, DtNode* node) {
     Arena* allocator = &(ctx->main_allocator);
     //Arena* name_alloc = &(ctx->name_allocator);
     DtObject v1, v2;
@@ -98,7 +151,18 @@ DtObject dte_eval_expression(DtContext* ctx, DtNode* node) {
         case NK_EQALITY:
             v1 = dte_eval_expression(ctx, node->children);
             v2 = dte_eval_expression(ctx, node->children->next);
-            return dto_object_compare(v1, v2, DT_COMPARE_EQ);
+            v1 = dto_object_compare(v1, v2, DT_COMPARE_EQ);
+            // `!=`
+            if (!(node->properties & NKP_IS_EQALITY)) 
+                v1 = dto_object_unary(v1, DT_UNARY_NOT);
+            return v1;
+
+        case NK_COMPARISON:
+            v1 = dte_eval_expression(ctx, node->children);
+            v2 = dte_eval_expression(ctx, node->children->next);
+            return dto_object_compare(v1, v2, 
+                    ((node->properties & NKP_IS_CMP_GT) ? DT_COMPARE_GT : DT_COMPARE_LT) |
+                    ((node->properties & NKP_IS_CMP_EQ) ? DT_COMPARE_EQWITH : 0));
 
             // LITTERALS
         case NK_BOOLIT:
@@ -107,29 +171,20 @@ DtObject dte_eval_expression(DtContext* ctx, DtNode* node) {
             return dte_object_from_numeric_literall(node);
         case NK_STRLIT:
             v1 = dto_string_new(allocator, dto_ident(""), 0, 
-                    node->identifier.data.as_word.length);
+                    dtp_node_text(node).length);
             dt_error result = dto_string_set_sized(&v1, 
-                    node->identifier.data.as_word.data,
-                    node->identifier.data.as_word.length
+                    dtp_node_text(node).data,
+                    dtp_node_text(node).length
             );
             // TODO check result
             (void) result;
             return v1;
 
         case NK_FUNCTION_CALL:
-            {
-                // find function, make sure it exists
-                DtObject func = dto_scope_get(ctx->functions, dte_ident_from_token(node->identifier));
-                // TODO: error checking
-                assert(dte_object_is_valid(func)); 
-                v1 = dte_eval_function(ctx, (DtNode*)func.value.as_function.entry);
-                return v1;
-            }
-            break;
+            return dte_eval_call(ctx, node);
 
         case NK_IDENTIFIER: 
-            r1 = dte_lookup_object(ctx, dte_ident_from_token(node->identifier));
-            assert(r1);
+            r1 = dte_lookup_slot(ctx, node);
             v1 = *r1;
             return v1;
             
@@ -156,14 +211,12 @@ DtObject dte_object_from_ast(DtContext* ctx, DtNode* node, int parent_id) {
     // prase name
     switch(node->kind) {
         case NK_VARIABLE:
-            o = dto_object_new(dte_ident_from_token(node->identifier), 0);
+            o = dto_object_new(dte_ident_from_node(node), 0);
         break;
 
+        // unnamed field, object names it by position
         case NK_RVALUE: 
-            o = dte_object_from_ast(ctx, child, 0);
-            o.identifier = dte_ident_from_id(name_alloc, parent_id);
-            return o;
-        break;
+            return dte_object_from_ast(ctx, child, parent_id);
 
         case NK_OBJECT: 
             {
@@ -172,7 +225,7 @@ DtObject dte_object_from_ast(DtContext* ctx, DtNode* node, int parent_id) {
                 while(fields) {
                     v1 = dte_object_from_ast(ctx, fields, field_id);
                     if (!dte_has_ident(v1))
-                        v1.identifier = dte_ident_from_token(fields->identifier);
+                        v1.identifier = dte_field_ident(name_alloc, fields, field_id);
                     dto_object_append(allocator, &o, v1);
                     
                     fields = fields->next;
@@ -180,7 +233,9 @@ DtObject dte_object_from_ast(DtContext* ctx, DtNode* node, int parent_id) {
                 }
                 return o;
             } break;
-        default: return DT_OBJECT_NULL;
+
+        // unnamed field without NK_RVALUE around it, see dtopt_compact
+        default: return dte_eval_expression(ctx, node);
     }
 
     // parse data
@@ -197,7 +252,7 @@ DtObject dte_object_from_ast(DtContext* ctx, DtNode* node, int parent_id) {
                 while(fields) {
                     v1 = dte_object_from_ast(ctx, fields, field_id);
                     if (!dte_has_ident(v1))
-                        v1.identifier = dte_ident_from_token(fields->identifier);
+                        v1.identifier = dte_field_ident(name_alloc, fields, field_id);
                     dto_object_append(allocator, &o, v1);
                     
                     fields = fields->next;
@@ -206,9 +261,9 @@ DtObject dte_object_from_ast(DtContext* ctx, DtNode* node, int parent_id) {
                 return o;
             } break;
 
-        case NK_EXPRESSION:
-            return dte_eval_expression(ctx, node->children);
-        default: return DT_OBJECT_NULL;
+        // anything else is an expression, parser does not wrap them
+        default: 
+            return dte_eval_expression(ctx, child);
     }
     return o;
 }
@@ -217,81 +272,59 @@ DtObject dte_object_from_ast(DtContext* ctx, DtNode* node, int parent_id) {
 DtObject dte_eval_scope(DtContext* ctx, DtNode* node) {
     DtObject var;
     DtObject* ref;
-    DtScope* s = ctx->current;
+    DtNode* call;
     assert(node->kind == NK_BLOCK);
     
     DtNode* next = node->children;
     while(next) {
         switch(next->kind) {
             
+            // declaration or assignment, resolver gave both the slot
             case NK_VARIABLE:
-                ref = dte_lookup_object(ctx, dte_ident_from_token(next->identifier));
-                if (!ref) {
-                    var = dte_object_from_ast(ctx,next, 0);
-                    var.identifier = dte_ident_from_token(next->identifier);
-                    dto_scope_push(s, var);
-                } else {
-                    *ref = dte_eval_expression(ctx, next->children);
-                }
+                ref  = dte_lookup_slot(ctx, next);
+                *ref = dte_object_from_ast(ctx, next, 0);
+                ref->identifier = dte_ident_from_node(next);
                 break;
 
+            // call that gives the value runs after this function is left,
+            // see __dte_eval_frame
             case NK_RETURN:
-                var = dte_eval_expression(ctx, next->children);
+                if ((call = dte_tail_call(next))) {
+                    ctx->tail = __dte_eval_args(ctx, call, true);
+                    var = ctx->tail ? DT_OBJECT_NULL : dto_object_error(DTR_ERROR_STACK_OVERFLOW);
+                } else {
+                    var = dte_eval_expression(ctx, next->children);
+                }
                 ctx->ret = var;
+                ctx->returning = true;
                 goto end;
                 break;
 
+            // branches are NK_IF with condition and block, last one
+            // can have only block (else)
             case NK_IF_STATEMENT:
-                {
-                    DtNode* ifb     = dtp_node_get(next, NK_IF);
-                    DtNode* elseb   = dtp_node_get(next, NK_ELSE);
-                    DtNode* elseifb = dtp_node_get(next, NK_ELSEIFS);
-
-                    if(!ctx->eval_mode) {
-                        // if branch is always present
-                        var = dte_eval_expression(ctx, dtp_node_index(ifb->children, 0));
-                        if (var.value.as_byte) {
-                            dte_eval_scope(ctx, dtp_node_index(ifb->children, 1));
-                            goto end_statement;
-                        }
-                        
-                        // else if branches
-                        if(elseifb) {
-                            DtNode* elseifnext = elseifb->children;
-                            while(elseifnext) {
-                                var = dte_eval_expression(ctx, dtp_node_index(elseifnext->children, 0));
-                                if (var.value.as_byte) {
-                                    dte_eval_scope(ctx, dtp_node_index(elseifnext->children, 1));
-                                    goto end_statement;
-                                }
-                                elseifnext = elseifnext->next;
-                            }
+                if(!ctx->eval_mode) {
+                    for(DtNode* branch = next->children; branch; branch = branch->next) {
+                        DtNode* cond = branch->children->next ? branch->children : NULL;
+                        if (cond) {
+                            var = dte_eval_expression(ctx, cond);
+                            if (!var.value.as_byte) continue;
                         }
-
-                        // else branch
-                        if(elseb) {
-                            dte_eval_scope(ctx, dtp_node_index(elseb->children, 0));
-                        }
-                        
+                        dte_eval_scope(ctx, cond ? cond->next : branch->children);
+                        break;
                     }
+                    // return in the branch leaves the function
+                    if (ctx->returning) goto end;
                 }
                 break;
 
                 // function call not in expression, return ignored
             case NK_FUNCTION_CALL: 
-                {
-                    // find function, make sure it exists
-                    DtObject func = dto_scope_get(ctx->functions, dte_ident_from_token(next->identifier));
-                    // TODO:
-                    printf("called function\n");
-                    assert(dte_object_is_valid(func)); 
-                    dte_eval_function(ctx, (DtNode*)func.value.as_function.entry);
-                }
+                dte_eval_call(ctx, next);
                 break;
 
             default: assert(0 && "TODO:");
         }
-end_statement:
         next = next->next; 
     }
 
@@ -299,58 +332,145 @@ end:
     return var;
 }
 
-DtObject dte_eval_function(DtContext* ctx, DtNode* node) {
+// body of function is parsed and its locals have slots
+DtNode* __dte_function_ready(DtContext* ctx, DtNode* node) {
     DtNode* body = dtp_node_get(node, NK_BLOCK);
     assert(node->kind == NK_FUNCTION_DECL);
     assert(body->kind == NK_BLOCK);
-    
+
+    // first call, body was only skipped by parser
+    if (body->properties & NKP_IS_LAZY) {
+        assert(ctx->parser && "Lazy function body needs parser");
+        dtp_block_parse(ctx->parser, body);
+    }
+    if (!(node->properties & NKP_IS_RESOLVED))
+        dte_resolve_function(node, &ctx->functions);
+    return body;
+}
+
+// frames of calls follow each other on one stack, allocated on first
+// call. Tail calls do not go deeper, they take frame of their caller
+bool __dte_frame_fits(DtContext* ctx, size_t slots, bool tail) {
+    if (!ctx->stack) {
+        ctx->stack = calloc(DT_STACK_SLOTS, sizeof(DtObject));
+        assert(ctx->stack && "Failed to allocate value stack");
+    }
+    if (!tail && ctx->call_depth >= DT_MAX_CALL_DEPTH) return false;
+    return ctx->stack_top + slots <= DT_STACK_SLOTS;
+}
+
+// runs function in frame at the top of the stack, first `argc` slots
+// of it have the arguments
+DtObject __dte_eval_frame(DtContext* ctx, DtNode* node, size_t argc) {
+    DtObject* frame = ctx->stack + ctx->stack_top;
+
     // setup
-    DtObject ret = DT_OBJECT_NULL;
-    DtScope 
-        s = dto_scope_init(),
-        *before = ctx->current;
+    DtObject* before = ctx->slots;
+    const size_t top = ctx->stack_top;
     ctx->call_depth++;
-    ctx->current = &s;
-
-    // body
-    ret = dte_eval_scope(ctx, body);
-    ret = ctx->ret;
+    ctx->slots = frame;
+
+    for(;;) {
+        memset(frame + argc, 0, (node->slot - argc) * sizeof(*frame));
+        ctx->stack_top = top + node->slot;
+        ctx->ret       = DT_OBJECT_NULL;
+
+        // body
+        dte_eval_scope(ctx, __dte_function_ready(ctx, node));
+        ctx->returning = false;
+        if (!ctx->tail) break;
+
+        // `return f(...)`, arguments were put right above this frame,
+        // callee runs in it instead of going deeper
+        const DtFunc* func = ctx->tail;
+        ctx->tail = NULL;
+        node = func->entry;
+        argc = func->arity;
+        memmove(frame, ctx->stack + ctx->stack_top, argc * sizeof(*frame));
+    }
 
     // restore
-    ctx->current = before;
-    dto_scope_clear(&s);
+    ctx->stack_top = top;
+    ctx->slots = before;
     ctx->call_depth--;
-    return ret;
+    return ctx->ret;
+}
+
+// function called without arguments, entry point
+DtObject dte_eval_function(DtContext* ctx, DtNode* node) {
+    __dte_function_ready(ctx, node);
+    if (!__dte_frame_fits(ctx, node->slot, false))
+        return dto_object_error(DTR_ERROR_STACK_OVERFLOW);
+    return __dte_eval_frame(ctx, node, 0);
+}
+
+// callee of `node`, its arguments are evaluated straight into slots
+// at the top of the stack, where its frame starts. Stack top follows
+// them so calls in arguments go above. NULL when frame does not fit
+const DtFunc* __dte_eval_args(DtContext* ctx, DtNode* node, bool tail) {
+    // find function, make sure it exists
+    const DtFunc* func = dte_callee(&ctx->functions, node);
+    // TODO: error checking
+    assert(func && "Call of unknown function");
+    __dte_function_ready(ctx, func->entry);
+    if (!__dte_frame_fits(ctx, ((DtNode*) func->entry)->slot, tail)) return NULL;
+
+    const size_t top = ctx->stack_top;
+    size_t argc = 0;
+    for(DtNode* arg = node->children; arg; arg = arg->next) {
+        assert(argc < func->arity && "Too many arguments");
+        ctx->stack[top + argc] = dte_eval_expression(ctx, arg);
+        ctx->stack_top = top + ++argc;
+    }
+    assert(argc == func->arity && "Too few arguments");
+    ctx->stack_top = top;
+    return func;
+}
+
+DtObject dte_eval_call(DtContext* ctx, DtNode* node) {
+    const DtFunc* func = __dte_eval_args(ctx, node, false);
+    if (!func) return dto_object_error(DTR_ERROR_STACK_OVERFLOW);
+    return __dte_eval_frame(ctx, func->entry, func->arity);
 }
 
 dt_enum8 dte_basic_type_from_ast(DtNode* n) {
     if (!n) return DT_TYPE_VOID;
-    Token ident = n->identifier;
-    if      (Token_compare_cstr(ident, "byte"))     return DT_TYPE_BYTE;
-    else if (Token_compare_cstr(ident, "bool"))     return DT_TYPE_BOOL;
-    else if (Token_compare_cstr(ident, "int"))      return DT_TYPE_INT;
-    else if (Token_compare_cstr(ident, "long"))     return DT_TYPE_LONG;
-    else if (Token_compare_cstr(ident, "float"))    return DT_TYPE_FLOAT;
-    else if (Token_compare_cstr(ident, "double"))   return DT_TYPE_DOUBLE;
-    else if (Token_compare_cstr(ident, "string"))   return DT_TYPE_STRING;
+    if      (dtp_node_compare_cstr(n, "byte"))     return DT_TYPE_BYTE;
+    else if (dtp_node_compare_cstr(n, "bool"))     return DT_TYPE_BOOL;
+    else if (dtp_node_compare_cstr(n, "int"))      return DT_TYPE_INT;
+    else if (dtp_node_compare_cstr(n, "long"))     return DT_TYPE_LONG;
+    else if (dtp_node_compare_cstr(n, "float"))    return DT_TYPE_FLOAT;
+    else if (dtp_node_compare_cstr(n, "double"))   return DT_TYPE_DOUBLE;
+    else if (dtp_node_compare_cstr(n, "string"))   return DT_TYPE_STRING;
     else return DT_TYPE_VOID;
 }
 
 void dte_eval_prepass(DtContext* ctx, DtNode* tree) {
     DtScope* funcs = &ctx->functions;
     DtNode* next = tree->children;
+
+    // cleared table is set up again in place, its version keeps counting
+    if (!funcs->objects) {
+        const unsigned int version = funcs->version;
+        *funcs = dto_scope_init();
+        funcs->version = version;
+    }
+    funcs->version++;
     while(next) {
         switch(next->kind) {
             case NK_FUNCTION_DECL:
                 {
                     DtNode* arguments = dtp_node_get(next, NK_FUNCTION_ARGS);
-                    DtNode* ret_type  = dtp_node_get(next, NK_TYPE);
+                    DtNode* ret_type  = NULL;
+                    // not dtp_node_get, it would find type of an argument first
+                    for(DtNode* it = next->children; it; it = it->next)
+                        if (it->kind == NK_TYPE) ret_type = it;
 
                     DtObject obj_func = {
-                        .identifier = dte_ident_from_token(next->identifier),
+                        .identifier = dte_ident_from_node(next),
                         .value.type = DT_TYPE_FUNCTION,
                         .value.as_function = {
-                            .name = dte_ident_from_token(next->identifier),
+                            .name = dte_ident_from_node(next),
                             .return_type = dte_basic_type_from_ast(ret_type),
                             .entry = next,
                         }
@@ -364,8 +484,10 @@ void dte_eval_prepass(DtContext* ctx, DtNode* tree) {
                             .value.as_type.typeid = dte_basic_type_from_ast(argnext->children)
                         };
                         dto_object_append(&funcs->temporary_memory, &obj_args, arg);
+                        obj_func.value.as_function.arity++;
                         argnext = argnext->next;
                     }
+                    obj_func.value.as_function.arguments = obj_args.children;
 
                     dto_scope_push(funcs, obj_func);
                 }
@@ -377,6 +499,139 @@ void dte_eval_prepass(DtContext* ctx, DtNode* tree) {
     }
 }
 
+//
+// RESOLVER
+//
+// Locals of a function are slots of one flat frame, arguments take the
+// first ones. Name declared in a block is seen by blocks nested in it
+// only, and slots of a block that ended are taken again by the next one.
+//
+
+typedef struct {
+    DtIdentifer     name;
+    unsigned short  slot;
+    unsigned short  depth;
+} DteLocal;
+
+typedef struct {
+    DteLocal*       items; // visible locals, innermost last
+    size_t          count, capacity;
+    size_t          frame; // most slots visible at once
+    unsigned short  depth;
+    DtScope*        functions;
+} DteResolver;
+
+DteLocal* __dte_resolve_find(DteResolver* r, DtIdentifer name) {
+    for(size_t i = r->count; i > 0; i--)
+        if (dte_same_ident(r->items[i-1].name, name)) return &r->items[i-1];
+    return NULL;
+}
+
+void __dte_resolve_declare(DteResolver* r, DtNode* node) {
+    assert(r->count < 0xFFFF && "Too many locals in function");
+    DteLocal local = {
+        .name  = dte_ident_from_node(node),
+        .slot  = (unsigned short)(r->count + 1),
+        .depth = r->depth,
+    };
+    da_append(r, local);
+    if (r->count > r->frame) r->frame = r->count;
+    node->slot  = local.slot;
+    node->depth = local.depth;
+}
+
+// names are looked up in values only, fields of objects are not locals
+void __dte_resolve_expr(DteResolver* r, DtNode* node) {
+    if (!node) return;
+    switch(node->kind) {
+        case NK_IDENTIFIER: {
+            DteLocal* local = __dte_resolve_find(r, dte_ident_from_node(node));
+            node->slot  = local ? local->slot  : 0;
+            node->depth = local ? local->depth : 0;
+        } break;
+
+        case NK_FUNCTION_CALL:
+            if (r->functions) dte_callee(r->functions, node);
+            for(DtNode* it = node->children; it; it = it->next)
+                __dte_resolve_expr(r, it);
+            break;
+
+        default:
+            for(DtNode* it = node->children; it; it = it->next)
+                __dte_resolve_expr(r, it);
+    }
+}
+
+void __dte_resolve_block(DteResolver* r, DtNode* block) {
+    const size_t visible = r->count;
+    r->depth++;
+    for(DtNode* it = block->children; it; it = it->next) {
+        switch(it->kind) {
+            // first assignment declares, value does not see the new name
+            case NK_VARIABLE: {
+                __dte_resolve_expr(r, it->children);
+                DteLocal* local = __dte_resolve_find(r, dte_ident_from_node(it));
+                if (!local) {
+                    __dte_resolve_declare(r, it);
+                    break;
+                }
+                it->slot  = local->slot;
+                it->depth = local->depth;
+            } break;
+
+            // branches are condition and block, else is block only
+            case NK_IF_STATEMENT:
+                for(DtNode* branch = it->children; branch; branch = branch->next)
+                    for(DtNode* part = branch->children; part; part = part->next) {
+                        if (part->kind == NK_BLOCK) __dte_resolve_block(r, part);
+                        else                        __dte_resolve_expr(r, part);
+                    }
+                break;
+
+            case NK_BLOCK:
+                __dte_resolve_block(r, it);
+                break;
+
+            default:
+                __dte_resolve_expr(r, it);
+        }
+    }
+    r->depth--;
+    r->count = visible;
+}
+
+// body has to be parsed already. Callees of calls are cached from
+// `functions` when it is given. Returns slots frame of it needs
+size_t dte_resolve_function(DtNode* decl, DtScope* functions) {
+    assert(decl->kind == NK_FUNCTION_DECL);
+    DteResolver r = { .functions = functions };
+    DtNode* args  = dtp_node_get(decl, NK_FUNCTION_ARGS);
+    DtNode* body  = dtp_node_get(decl, NK_BLOCK);
+    assert(body && !(body->properties & NKP_IS_LAZY));
+
+    size_t arity = 0;
+    for(DtNode* arg = args ? args->children : NULL; arg; arg = arg->next, arity++)
+        __dte_resolve_declare(&r, arg);
+    __dte_resolve_block(&r, body);
+
+    free(r.items);
+    assert(r.frame <= 0xFFFF);
+    decl->slot        = (unsigned short) r.frame;
+    decl->depth       = (unsigned short) arity;
+    decl->properties |= NKP_IS_RESOLVED;
+    return r.frame;
+}
+
+// every function with parsed body, lazy ones are resolved on first call
+void dte_resolve(DtContext* ctx, DtNode* tree) {
+    for(DtNode* it = tree->children; it; it = it->next) {
+        if (it->kind != NK_FUNCTION_DECL) continue;
+        DtNode* body = dtp_node_get(it, NK_BLOCK);
+        if (body && !(body->properties & NKP_IS_LAZY))
+            dte_resolve_function(it, &ctx->functions);
+    }
+}
+
 void dte_eval_root(DtContext* ctx, DtNode* tree) {
 
     // TODO: user can define entry point
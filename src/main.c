@@ -41,14 +41,15 @@
 // - use hashmap instead of linear lookup of variables
 
 // COMPLICATED
-// - make all code compile to simple register based vm assembly
+// ~ make all code compile to simple register based vm assembly
+//      + functions with numeric code compile to bytecode (vm.c)
 // - compiler and interpteter are two parts of one system
 // - compile to C and have dtdl_load() function to load such code.
 // - simple language runtime for dtdl functionalty
 
 #include <stdio.h>
 #define STACK_STARTING_CAPACITY 1024
-#include "eval.c"
+#include "runtime.c"
 
 #if 0
 int main(void) {
@@ -87,7 +88,7 @@ int main(void) {
     Token tok = {0};
 
     while((tok = Tokenizer_next_token(&t)).kind != TokenKind_EOF) {
-        printf("%s\n", Token_temp_cstr(tok));
+        printf("%s\n", Token_temp_cstr(&t, tok));
     }
 
     Tokenizer_free(&t);
@@ -95,6 +96,28 @@ int main(void) {
 }
 #endif
 
+#if 0
+int main(void) {
+    // parse stdin through a fixed size window, tokens, strings,
+    // line index and tree still grow with the input
+    TokenizerStream stream = {0};
+    DtStatus status = {
+        .file_name = "stdin",
+    };
+    DtParser parser = {
+        .lexer = DtTokenizer_init_stream(&stream, dt_read_file, stdin),
+        .stat = &status
+    };
+
+    DtNode* root = dtp_parse(&parser, 0);
+    dtp_print_ast(root, 0, stdout);
+
+    Tokenizer_stream_free(&stream);
+    TokenLines_free(&status.lines);
+    dtp_free(&parser);
+}
+#endif
+
 #if 0
 int main(void) {
     Arena a = {0};
@@ -119,13 +142,15 @@ int main(void) {
 // TODO: 
 // // locking hashes source and ast
 // // if either changes, recompile or re-eval
-// dtrt_lock();
-// dtrt_relock();
+// ~ dtrt_lock();
+// ~ dtrt_relock();
+//      + source is hashed, AST image is reused while it matches (runtime.c)
 //
 // // eval - does the type,function,symbol checking, runs code in shallow way
 // dtrt_eval();
 // // run - runs code fully with all the proper logic
-// dtrt_run();
+// ~ dtrt_run();
+//      + runs `main` on the VM, tree is walked when it does not compile
 //
 // // does both previous things
 // dtrt_eval_and_run();
@@ -180,6 +205,7 @@ int main(void) {
 
     DtContext ctx = {
         .functions = dto_scope_init(),
+        .parser = &parser,
     };
     /*
      if (root) {
@@ -192,9 +218,11 @@ int main(void) {
     }
     
     dto_scope_clear(&ctx.functions);
+    free(ctx.stack);
     free((void*)status.errors.items);
     sb_clear(&status.error_builder);
-    arena_reset(&parser.nodes);
+    TokenLines_free(&status.lines);
+    dtp_free(&parser);
     free(txt);
     // TODO: check for empty file
     return exit_code;
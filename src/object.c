@@ -1,8 +1,9 @@
 #include "common.c"
 
 typedef struct {
-    const char* name;
-    size_t      length;
+    const char*     name;
+    size_t          length;
+    unsigned int    id; // 1 + tokenizer's symbol id, 0 if name is not interned
 } DtIdentifer;
 
 // 
@@ -50,6 +51,7 @@ enum {
     DT_ERROR_UNRESOLVABLE_TYPE,
     DT_ERROR_UNRESOLVABLE_COMPLEX_TYPE,
     DTR_ERROR_UNSUPPORTED_OPERAION,
+    DTR_ERROR_STACK_OVERFLOW,
 };
 
 struct DtObject;
@@ -64,6 +66,7 @@ typedef struct DtFunc {
     dt_enum8    return_type;
     dt_bitmask8 return_properties;
     dt_bitmask8 properties;
+    unsigned short      arity;
     DtIdentifer         name;
     struct DtObject*    arguments;
     void*               entry;
@@ -102,6 +105,7 @@ typedef struct DtObject {
     DtIdentifer        identifier;
     struct DtObject*   next;
     struct DtObject*   children; 
+    struct DtObject*   last_child; // tail of children, for dto_object_append
     //dt_numeric              typetable_id;
 } DtObject;
 
@@ -124,6 +128,12 @@ typedef struct DtScope {
     DtObject*   objects;
     Arena       temporary_memory;
     size_t      count, capacity;
+    // interned names go straight to their object: 1 + index into objects
+    long int*   by_id;
+    size_t      by_id_count;
+    // bumped when objects change, pointers to them are checked against
+    // it (see dte_callee). Clearing keeps counting, so it never repeats
+    unsigned int version;
 } DtScope;
 
 typedef struct DtScopeList {
@@ -138,6 +148,7 @@ typedef struct DtStackFrame {
 } DtStackFrame;
 
 #define DT_MAX_CALL_DEPTH 256
+#define DT_STACK_SLOTS    (1 << 14) // locals of all frames, see dte_eval_call
 
 typedef struct DtContext {
     Arena           main_allocator;
@@ -150,11 +161,20 @@ typedef struct DtContext {
     DtScope         global;
     
     DtScope*        current;
+    DtObject*       slots;  // frame of running function, see dte_resolve_function
+    DtObject*       stack;  // DT_STACK_SLOTS, frames of all calls
+    size_t          stack_top;
     size_t          node_depth;
     size_t          call_depth;
     
     DtObject       ret;
+    const DtFunc*   tail;      // `return f(...)` is left to take the frame
+    bool            returning; // blocks are left up to the function
     bool            eval_mode;
+
+    // DtParser* that made the tree, bodies of functions
+    // are parsed through it on first call when it is lazy
+    void*           parser;
 } DtContext;
 
 //
@@ -214,6 +234,9 @@ DtObject dto_object_from_numeric(DtIdentifer name, dt_bitmask8 type, dt_numeric
         case DT_TYPE_INT:
             result.value.as_int = raw_bytes;
             break;
+        case DT_TYPE_LONG:
+            result.value.as_long = raw_bytes;
+            break;
         case DT_TYPE_FLOAT:
             memcpy( &result.value.as_float, 
                     &raw_bytes, 
@@ -261,12 +284,13 @@ void dto_object_append(Arena* allocator, DtObject* o, DtObject field) {
     DtObject* item = arena_alloc(allocator, sizeof(field));
     memcpy(item, &field, sizeof(field));
 
-    if (o->children) {
-        DtObject* it = o->children;
-        if (!it)  { it = item; return; }
-        while(it) { if (!it->next) break; it = it->next; } 
-        it->next = item;
-    } else o->children = item;
+    item->next = NULL;
+
+    if (o->children) 
+        o->last_child->next = item;
+    else 
+        o->children = item;
+    o->last_child = item;
 }
 
 size_t dto_type_size(dt_enum8 type) {
@@ -462,12 +486,23 @@ int dto_type_resolve(DtObject* l, DtObject* r) {
         higher->value.type == DT_TYPE_OBJECT 
     ;
 
+    // integers are read with their own width, so negative ones stay negative
+    double as_real = 0;
+    switch(lower->value.type) {
+        case DT_TYPE_BOOL:
+        case DT_TYPE_BYTE:   as_real = lower->value.as_byte;   break;
+        case DT_TYPE_INT:    as_real = lower->value.as_int;    break;
+        case DT_TYPE_FLOAT:  as_real = lower->value.as_float;  break;
+        default:             as_real = lower->value.as_long;   break;
+    }
     lower->value.type = higher->value.type;
     
     if (h_is_integer)
         lower->value.as_long = (long long)(lower->value.as_long);
+    else if (h_is_float && higher->value.type == DT_TYPE_DOUBLE)
+        lower->value.as_double = as_real;
     else if (h_is_float)
-        lower->value.as_float = (float)(lower->value.as_long);
+        lower->value.as_float = (float) as_real;
     else {
         (void) h_is_object;
         // TODO: add unique type-to-code error
@@ -489,9 +524,24 @@ enum {
     DT_COMPARE_EQWITH = (1 << 7),
 };
 
+// -1, 0 or 1, both sides have to be of the same numeric type
+int dto_numeric_order(DtObject l, DtObject r) {
+#define DT_ORDER(FIELD) ((l.value.FIELD > r.value.FIELD) - (l.value.FIELD < r.value.FIELD))
+    switch(l.value.type) {
+        case DT_TYPE_BOOL:
+        case DT_TYPE_BYTE:   return DT_ORDER(as_byte);
+        case DT_TYPE_INT:    return DT_ORDER(as_int);
+        case DT_TYPE_LONG:   return DT_ORDER(as_long);
+        case DT_TYPE_FLOAT:  return DT_ORDER(as_float);
+        case DT_TYPE_DOUBLE: return DT_ORDER(as_double);
+        default: assert(0 && "TODO: ordering of non numeric types");
+    }
+    return 0;
+#undef DT_ORDER
+}
+
 // DONE:
 //  + pure equality
-// TODO:
 //  + greater than,
 //  + less than,
 //  + g/l than with equality
@@ -544,11 +594,66 @@ DtObject dto_object_compare(DtObject l, DtObject r, dt_enum8 cmp_type) {
                 break;
             }
         break;
+
+        case DT_COMPARE_GT:
+        case DT_COMPARE_GT | DT_COMPARE_EQWITH:
+        case DT_COMPARE_LT:
+        case DT_COMPARE_LT | DT_COMPARE_EQWITH: 
+            {
+                const int order = dto_numeric_order(l, r);
+                const int want  = ((cmp_type & ~DT_COMPARE_EQWITH) == DT_COMPARE_GT) ? 1 : -1;
+                result.value.as_byte = 
+                    order == want || ((cmp_type & DT_COMPARE_EQWITH) && order == 0);
+            }
+        break;
     }
 
     return result;
 }
 
+enum {
+    DT_UNARY_NEG,
+    DT_UNARY_NOT,
+};
+
+DtObject dto_object_unary(DtObject v, dt_enum8 unary_type) {
+    DtObject result = v;
+    switch(unary_type) {
+        case DT_UNARY_NEG:
+            switch(v.value.type) {
+                // as int with rest of the value zero, equality compares all of it
+                case DT_TYPE_BOOL:
+                    result = dto_object_from_numeric(v.identifier, DT_TYPE_INT, -(int) v.value.as_byte);
+                    break;
+                case DT_TYPE_BYTE:   result.value.as_byte   = -v.value.as_byte;   break;
+                case DT_TYPE_INT:    result.value.as_int    = -v.value.as_int;    break;
+                case DT_TYPE_LONG:   result.value.as_long   = -v.value.as_long;   break;
+                case DT_TYPE_FLOAT:  result.value.as_float  = -v.value.as_float;  break;
+                case DT_TYPE_DOUBLE: result.value.as_double = -v.value.as_double; break;
+                default: return dto_object_error(DTR_ERROR_UNSUPPORTED_OPERAION);
+            }
+        break;
+
+        case DT_UNARY_NOT:
+            result = DT_OBJECT_NULL;
+            result.value.type = DT_TYPE_BOOL;
+            switch(v.value.type) {
+                case DT_TYPE_BOOL:
+                case DT_TYPE_BYTE:   result.value.as_byte = !v.value.as_byte;   break;
+                case DT_TYPE_INT:    result.value.as_byte = !v.value.as_int;    break;
+                case DT_TYPE_LONG:   result.value.as_byte = !v.value.as_long;   break;
+                case DT_TYPE_FLOAT:  result.value.as_byte = !v.value.as_float;  break;
+                case DT_TYPE_DOUBLE: result.value.as_byte = !v.value.as_double; break;
+                default: return dto_object_error(DTR_ERROR_UNSUPPORTED_OPERAION);
+            }
+        break;
+
+        default:
+            return dto_object_error(DTR_ERROR_UNSUPPORTED_OPERAION);
+    }
+    return result;
+}
+
 DtObject dto_object_binop(DtObject l, DtObject r, dt_enum8 binop_type) {
     
 #define DT_BINOP(result, l,r,OP) \
@@ -621,7 +726,22 @@ void dto_scope_clear(DtScope* s) {
     arena_reset(&s->temporary_memory);
     map_clear(&s->head);
     free(s->objects);
+    free(s->by_id);
+    const unsigned int version = s->version;
     memset(s, 0, sizeof(*s));
+    s->version = version + 1;
+}
+
+void dto_scope_bind_id(DtScope* s, unsigned int id, long int oid) {
+    if (id >= s->by_id_count) {
+        size_t count = s->by_id_count ? s->by_id_count : 64;
+        while(count <= id) count *= 2;
+        s->by_id = realloc(s->by_id, count * sizeof(*s->by_id));
+        assert(s->by_id && "Failed to grow scope id index");
+        memset(s->by_id + s->by_id_count, 0, (count - s->by_id_count) * sizeof(*s->by_id));
+        s->by_id_count = count;
+    }
+    s->by_id[id] = oid + 1;
 }
 
 int dto_scope_push(DtScope* s, DtObject o) {
@@ -638,31 +758,45 @@ int dto_scope_push(DtScope* s, DtObject o) {
 
     s->objects[oid] = o;
     //transmute(&s->objects[oid], DtObject*) = o;
+    if (ident.id) dto_scope_bind_id(s, ident.id, oid);
 
     return 0;
 }
 
+// index of the object in scope, -1 if there is none.
+// interned names are resolved by id and hash only once per scope.
+// ids of different tokenizers overlap, so name of a hit is checked
+long int dto_scope_find(DtScope* s, DtIdentifer ident) {
+    if (ident.id && ident.id < s->by_id_count && s->by_id[ident.id]) {
+        const long int   oid   = s->by_id[ident.id] - 1;
+        const DtIdentifer found = s->objects[oid].identifier;
+        if (found.length == ident.length && 
+            (found.name == ident.name || memcmp(found.name, ident.name, ident.length) == 0))
+            return oid;
+    }
+
+    MapKeySlice key = map_slice(ident.name, ident.length);
+    long int oid = map_query(s->head, key);
+
+    // was pushed under name only
+    if (oid != -1 && ident.id) dto_scope_bind_id(s, ident.id, oid);
+    return oid;
+}
 
 DtObject* dto_scope_ref(DtScope* s, DtIdentifer ident) {
-    Map map = s->head;
     DtObject* result = 0; // invalid object
-
-    MapKeySlice key = map_slice(ident.name, ident.length);
-    long int oid = map_query(map, key);
+    long int oid = dto_scope_find(s, ident);
 
     if (oid == -1)  return result;
     else            return &(s->objects[oid]);
 }
 
-DtObject dto_scope_get(DtScope s, DtIdentifer ident) {
-    Map map = s.head;
+DtObject dto_scope_get(DtScope* s, DtIdentifer ident) {
     DtObject result = {0}; // invalid object
-
-    MapKeySlice key = map_slice(ident.name, ident.length);
-    long int oid = map_query(map, key);
+    long int oid = dto_scope_find(s, ident);
 
     if (oid == -1)  return result;
-    else            return s.objects[oid];
+    else            return s->objects[oid];
 }
 
 
@@ -957,11 +1091,11 @@ int main(void) {
         .spacing = "  ",
     };
 
-    dto_serialize(buffer, 1024, opt, dto_scope_get(stack, dto_ident("object")));
+    dto_serialize(buffer, 1024, opt, dto_scope_get(&stack, dto_ident("object")));
     printf("%s\n", buffer);
 
     memset(buffer, 0 , 1024);
-    dto_serialize(buffer, 1024, opt, dto_scope_get(stack, dto_ident("array")));
+    dto_serialize(buffer, 1024, opt, dto_scope_get(&stack, dto_ident("array")));
     printf("%s\n", buffer);
  
     memset(buffer, 0 , 1024);
@@ -970,14 +1104,14 @@ int main(void) {
  
 
     memset(buffer, 0 , 1024);
-    dto_serialize(buffer, 1024, opt, dto_scope_get(stack, dto_ident("string")));
+    dto_serialize(buffer, 1024, opt, dto_scope_get(&stack, dto_ident("string")));
     printf("%s\n", buffer);
 
 
     dto_object_append(temp,&o, str);
 
     memset(buffer, 0 , 1024);
-    dto_serialize(buffer, 1024, opt, dto_scope_get(stack, dto_ident("array_objects")));
+    dto_serialize(buffer, 1024, opt, dto_scope_get(&stack, dto_ident("array_objects")));
     printf("%s\n", buffer);
 
     dto_scope_clear(&stack);
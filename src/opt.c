@@ -0,0 +1,203 @@
+#include "eval.c"
+
+//
+// OPTIMIZATION PASSES
+//
+// Run over the tree after dtp_parse and before it is evaluated. Nodes are
+// changed in place, so tree should not be given to dtp_reparse after.
+//
+#ifndef __DT_OPT_H
+#define __DT_OPT_H
+
+//
+// CONSTANT FOLDING
+//
+// Operators that have only literals under them are evaluated once by the
+// evaluator itself, so semantics are the same, and become a literal of the
+// result. Literal is used only if it evaluates back to exactly the same
+// type and bits, `-2147483648` is not folded since literal of it is int
+// and expression is long. Integer division that would trap is left for
+// the runtime too.
+//
+
+static inline bool __dtopt_is_literal(const DtNode* n) {
+    return n->kind == NK_INTLIT || n->kind == NK_FLTLIT || n->kind == NK_BOOLIT;
+}
+
+static inline bool __dtopt_is_operator(const DtNode* n) {
+    switch(n->kind) {
+        case NK_EXPRESSION: 
+        case NK_EQALITY:
+        case NK_COMPARISON:
+        case NK_TERM:
+        case NK_FACTOR:
+            return true;
+        default: 
+            return false;
+    }
+}
+
+static inline bool __dtopt_is_integer(dt_enum8 type) {
+    return type == DT_TYPE_BOOL || type == DT_TYPE_BYTE || type == DT_TYPE_INT || type == DT_TYPE_LONG;
+}
+
+// bits past the type's field are compared too, dto_type_resolve reads them
+bool __dtopt_same_value(DtObject a, DtObject b) {
+    return 
+        a.value.type       == b.value.type && 
+        a.value.properties == b.value.properties &&
+        (a.value.type == DT_TYPE_BOOL || a.value.type == DT_TYPE_INT || 
+         a.value.type == DT_TYPE_LONG || a.value.type == DT_TYPE_FLOAT ||
+         a.value.type == DT_TYPE_DOUBLE) &&
+        memcmp(&a.value.as_long, &b.value.as_long, sizeof(a.value.as_long)) == 0;
+}
+
+// division by zero or INT_MIN / -1, after types of operands are resolved
+bool __dtopt_division_traps(DtContext* ctx, const DtNode* node) {
+    if (node->kind != NK_FACTOR || (node->properties & NKP_IS_MUL)) return false;
+    DtObject l = dte_eval_expression(ctx, node->children);
+    DtObject r = dte_eval_expression(ctx, node->children->next);
+    if (!dto_type_resolve(&l, &r) || !__dtopt_is_integer(r.value.type)) return false;
+    switch(r.value.type) {
+        case DT_TYPE_INT:   return r.value.as_int  == 0 || r.value.as_int  == -1;
+        case DT_TYPE_LONG:  return r.value.as_long == 0 || r.value.as_long == -1;
+        default:            return r.value.as_byte == 0 || r.value.as_byte == -1;
+    }
+}
+
+// make `n` a literal of `v`, false if there is no literal for it
+bool __dtopt_make_literal(DtNode* n, DtObject v) {
+    Token t = { .offset = n->source_location.offset };
+    const char* text = NULL;
+    DtNodeKind  kind;
+
+    switch(v.value.type) {
+        case DT_TYPE_BOOL:
+            if (v.value.as_byte != 0 && v.value.as_byte != 1) return false;
+            kind     = NK_BOOLIT;
+            text     = v.value.as_byte ? "true" : "false";
+            t.kind   = TokenKind_word;
+            t.id     = v.value.as_byte ? TI_KW_TRUE : TI_KW_FALSE;
+            t.length = strlen(text);
+            break;
+        case DT_TYPE_INT:
+        case DT_TYPE_LONG:
+            kind   = NK_INTLIT;
+            t.kind = TokenKind_literall_integer;
+            __tkn_set_value(&t, (unsigned long long)
+                    (v.value.type == DT_TYPE_INT ? v.value.as_int : v.value.as_long));
+            break;
+        // float literals are doubles, a float value has no literal
+        case DT_TYPE_DOUBLE: {
+            const double d = v.value.as_double;
+            unsigned long long bits;
+            memcpy(&bits, &d, sizeof(bits));
+            kind   = NK_FLTLIT;
+            t.kind = TokenKind_literall_float;
+            __tkn_set_value(&t, bits);
+        } break;
+        default:
+            return false;
+    }
+
+    n->kind         = kind;
+    n->properties   = 0;
+    n->identifier   = t;
+    n->text         = text;
+    n->children     = NULL;
+    n->last_child   = NULL;
+    return true;
+}
+
+// returns number of nodes that were folded away
+size_t dtopt_fold_constants(DtNode* node) {
+    if (!node) return 0;
+    size_t folded   = 0;
+    size_t children = 0;
+    bool   literals = true;
+    for(DtNode* it = node->children; it; it = it->next) {
+        folded   += dtopt_fold_constants(it);
+        literals &= __dtopt_is_literal(it);
+        children++;
+    }
+
+    const bool is_operator = __dtopt_is_operator(node) && children && literals;
+    const bool is_prefixed = __dtopt_is_literal(node) && (node->properties & (NKP_HAS_UNARY | NKP_HAS_NOT));
+    if (!is_operator && !is_prefixed) return folded;
+
+    DtContext ctx = {0};
+    if (__dtopt_division_traps(&ctx, node)) return folded;
+
+    const DtObject v = dte_eval_expression(&ctx, node);
+    DtNode literal   = *node;
+    if (!__dtopt_make_literal(&literal, v) || 
+        !__dtopt_same_value(dte_eval_expression(&ctx, &literal), v)) return folded;
+
+    *node = literal;
+    return folded + children;
+}
+
+//
+// COMPACTION
+//
+// Wrapper with one child only passes value of the child through, so child
+// takes its place. Named object fields are NK_VARIABLE already, unnamed
+// ones lose their NK_RVALUE, evaluator names fields by position either
+// way. Expression wrapper gives its prefix operators to the child, `-(!x)`
+// keeps it since negate of wrapper goes before not of the child.
+//
+
+size_t dtopt_count_nodes(const DtNode* node) {
+    size_t count = 0;
+    for(; node; node = node->next) count += 1 + dtopt_count_nodes(node->children);
+    return count;
+}
+
+// returns number of nodes that were removed
+size_t dtopt_compact(DtNode* node) {
+    if (!node) return 0;
+    size_t removed = 0;
+    for(DtNode* it = node->children; it; it = it->next) 
+        removed += dtopt_compact(it);
+
+    const int prefix = NKP_HAS_UNARY | NKP_HAS_NOT;
+    while((node->kind == NK_EXPRESSION || node->kind == NK_RVALUE) && 
+            node->children && node->children == node->last_child) {
+        DtNode* child = node->children;
+        if ((node->properties & prefix) && (child->properties & prefix)) break;
+
+        const int properties = child->properties | (node->properties & prefix);
+        DtNode*   next       = node->next;
+        *node = *child;
+        node->properties = properties;
+        node->next       = next;
+        removed++;
+    }
+    return removed;
+}
+
+//
+// PIPELINE
+//
+
+typedef struct {
+    size_t nodes_before;
+    size_t nodes_after;
+    size_t folded;      // nodes removed by dtopt_fold_constants
+    size_t compacted;   // nodes removed by dtopt_compact
+} DtOptStats;
+
+DtOptStats dtopt_run(DtNode* root) {
+    DtOptStats s = { .nodes_before = dtopt_count_nodes(root) };
+    s.folded      = dtopt_fold_constants(root);
+    s.compacted   = dtopt_compact(root);
+    s.nodes_after = dtopt_count_nodes(root);
+    return s;
+}
+
+void dtopt_print_stats(const DtOptStats* s, FILE* f) {
+    fprintf(f, "OPT: %zu nodes -> %zu (folded %zu, compacted %zu)\n",
+            s->nodes_before, s->nodes_after, s->folded, s->compacted);
+}
+
+#endif // __DT_OPT_H
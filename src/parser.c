@@ -1,5 +1,12 @@
 #include <errno.h>
+#include <limits.h>
 #include "common.c"
+#include "scan.c"
+
+#if !defined(DT_NO_THREADS) && !defined(_WIN32)
+#   define DT_TOKENIZER_THREADS
+#   include <pthread.h>
+#endif
 
 // TODO:
 // write tree treveral error printer
@@ -35,11 +42,22 @@ typedef unsigned int	tokenid_t;
 #ifndef TEMP_CSTR_LENGTH 
 #	define TEMP_CSTR_LENGTH 128
 #endif
+// printed token with kind and id, see __tkn_temp_cstr
+#define TOKENIZER_TEMP_CSTR_CAPACITY (TEMP_CSTR_LENGTH*3)
 
 #ifndef TOKENIZER_TOKEN_INITIAL_COUNT
 #	define TOKENIZER_TOKEN_INITIAL_COUNT 32
 #endif
 
+// parallel mode does not split input into chunks smaller then this
+#ifndef TOKENIZER_PARALLEL_MIN_CHUNK
+#	define TOKENIZER_PARALLEL_MIN_CHUNK (256 * 1024)
+#endif
+
+#ifndef TOKENIZER_MAX_THREADS
+#	define TOKENIZER_MAX_THREADS 64
+#endif
+
 
 typedef struct { 
 	const char* 	data;
@@ -63,20 +81,26 @@ typedef enum {
 	TokenKind_EOF,
 } TokenKind;
 
+typedef enum {
+    // aux is index of the token table entry, text is entry's text
+    TokenFlag_table     = 1,
+    // aux is reference into the stream pool, text is there
+    TokenFlag_pooled    = 2,
+    // aux is id of interned word in tokenizer's symbol table
+    TokenFlag_symbol    = 4,
+} TokenFlag;
+
+// 16 bytes, so token arrays stay dense in cache.
+// Text of words and strings is found through offset and length
+// (see Tokenizer_text), row and column are computed from offset
+// only when they are needed (see Tokenizer_location).
 typedef struct {
-    size_t 
-        row, 
-        col;
-
-	TokenKind 	kind;
-	tokenid_t	id;
-	union {
-		symbol_t 	as_symbol;
-		TknSlice	as_word;
-		int			as_int;
-		float		as_float;
-		bool		as_bool;
-	}			data;
+    unsigned char   kind;
+    unsigned char   flags;
+    unsigned short  id;
+    unsigned int    offset; // of the text in the whole input
+    unsigned int    length; // of the text
+    unsigned int    aux;    // symbol, literal bits, or where text is (flags)
 } Token;
 
 typedef struct {
@@ -85,61 +109,303 @@ typedef struct {
     size_t  capacity;
 } Tokens;
 
+// Line index: offsets of the first byte of every line but the first one.
+// Tokenizer fills it while reading, owner may be someone else (DtStatus)
 typedef struct {
-	char*		scratch_buffer;
-    size_t		scratch_buffer_sz;
+    unsigned int*   items;
+    size_t          count;
+    size_t          capacity;
+    size_t          indexed; // bytes of input looked at so far
+} TokenLines;
+
+// Streaming input: tokenizer pulls chunks through `read` into a window
+// and keeps only unconsumed bytes and token that straddles the boundary.
+// Word and string text is copied into the pool since window moves.
+// Only the input is bounded: tokens, pool and line index grow with the
+// input and are kept until the tokenizer is freed, dtp_parse lexes all
+// of it before parsing (see dtp_lex).
+typedef size_t (*TokenizerReadFn)(void* user, char* buffer, size_t capacity);
+
+#ifndef TOKENIZER_STREAM_WINDOW
+#	define TOKENIZER_STREAM_WINDOW (64 * 1024)
+#endif
+
+// refill window when less then this is left, so operators
+// and most of the words never cross the boundary
+#ifndef TOKENIZER_STREAM_LOOKAHEAD
+#	define TOKENIZER_STREAM_LOOKAHEAD 256
+#endif
+
+#ifndef TOKENIZER_POOL_BLOCK_SIZE
+#	define TOKENIZER_POOL_BLOCK_SIZE (64 * 1024)
+#endif
+
+typedef struct {
+    char**  items;
+    size_t  count;
+    size_t  capacity;
+    size_t  used; // bytes used in the last block
+} TokenPool;
+
+// Every distinct word is interned once, tokens carry dense id of it.
+// Hash is kept next to the text, so table grows without rehashing text
+// and users can key their own tables with it.
+typedef struct {
+    const char*     text;   // in source, or in stream pool
+    unsigned int    length;
+    unsigned int    hash;
+} TokenSymbol;
+
+#ifndef TOKENIZER_SYMBOLS_INITIAL_SLOTS
+#	define TOKENIZER_SYMBOLS_INITIAL_SLOTS 1024 // has to be power of two
+#endif
+
+typedef struct {
+    TokenSymbol*    items;
+    size_t          count;
+    size_t          capacity;
+    unsigned int*   slots;      // 1 + symbol id, 0 if slot is empty
+    size_t          slot_count;
+} TokenSymbols;
+
+typedef struct {
+    TokenizerReadFn read;
+    void*           user;
+    char*           window;
+    size_t          capacity;
+    size_t          offset; // offset of window[0] in the whole input
+    bool            eof;
+    TokenPool       pool;
+} TokenizerStream;
+
+// Matcher generated from the token table at init time.
+// Single byte symbols are resolved with one lookup into `single`,
+// multi byte operators and keywords go through a perfect hash that
+// is searched for (by trying seeds) when the tokenizer is initialized.
+#ifndef TOKENIZER_HASH_SIZE
+#	define TOKENIZER_HASH_SIZE 256 // has to be power of two
+#endif
+
+#define TOKENIZER_MAX_ENTRY_LENGTH 16
+#define TOKENIZER_MAX_SEED         (1 << 16) // seeds tried before giving up
+
+typedef struct {
+    const TokenTableEntry*  entry;
+    unsigned char           length;
+    bool                    is_keyword;
+} TokenMatcherSlot;
+
+typedef struct {
+    // 1 + index of single byte entry, 0 if there is none
+    unsigned short      single[256];
+    // bit N is set if operator of length (N + 2) starts with this byte
+    unsigned short      multi[256];
+
+    unsigned int        seed;
+    unsigned char       keyword_min,
+                        keyword_max;
+    TokenMatcherSlot    slots[TOKENIZER_HASH_SIZE];
+} TokenMatcher;
+
+typedef struct {
+    // Token_temp_cstr prints here, so every tokenizer has its own
+	char		scratch_buffer[TOKENIZER_TEMP_CSTR_CAPACITY];
 
     // config or user options
     bool                skip_newline;
     symbol_t 			string_quotes[2];
     const char*         comment_block[2];
-
-    // line tracking
-    size_t              row;
-    size_t              col;
+    const char*         comment_line;
+    size_t              comment_block_length[2];
+    size_t              comment_line_length;
+
+    // line tracking, allocated on first use if nobody attached one
+    size_t              first_row;
+    TokenLines*         lines;
+    bool                owns_lines;
 	
     // string info
     const char* 		target;
 	size_t				target_length;
 	size_t 				position;
 
-    // user input table
-	TokenTableEntry*	token_table;
+    // user input table, only read, can be shared between tokenizers
+	const TokenTableEntry*	token_table;
 	size_t				token_table_count;
+    const TokenTableEntry*  keyword_table;
+    size_t              keyword_table_count;
+    TokenMatcher        matcher;
+
+    // character class scanners picked for this cpu
+    const TknScanKernels* scan;
 
     // memory for linear allocation of tokens
     // arena kind of
 	Tokens		        tokens;
+
+    // not null when input is pulled in chunks
+    TokenizerStream*    stream;
+
+    // interned words
+    TokenSymbols        symbols;
+    // their text, when it outlived the input, see Tokenizer_retarget
+    TokenPool           detached;
+
+    // Tokenizer_run splits big inputs between this many threads
+    size_t              threads;
 } Tokenizer;
 
 
-void Tokenizer_init(
+bool __tkn_matcher_build(Tokenizer* t);
+void __tkn_pool_free(TokenPool* p);
+
+// false when no perfect hash was found for the tables, see __tkn_matcher_build
+bool Tokenizer_init(
 		Tokenizer* 			t, 
-		TokenTableEntry* 	table,
+		const TokenTableEntry* 	table,
 		size_t				table_len,
+        const TokenTableEntry*  keywords,
+        size_t              keywords_len,
 		const char*			target,
 		size_t				target_len,
-		char*				scratch_buffer,
 		symbol_t			quotations[2],
         const char*         comment_block[2],
+        const char*         comment_line,
         bool                skip_nl
     ) 
 {
 	assert(t && "Tokenizer pointer has to be valid");
+    assert(target_len < (unsigned int) -1 && "Input is too big for 32 bit token offsets");
 
 	*t = (Tokenizer) {
-		.scratch_buffer = scratch_buffer,
 		.target 		= target,
 		.target_length 	= target_len,
 		.string_quotes 	= { quotations[0],      quotations[1]       },
         .comment_block  = { comment_block[0],   comment_block[1]    },
+        .comment_block_length 
+                        = { strlen(comment_block[0]), strlen(comment_block[1]) },
+        .comment_line   = comment_line,
+        .comment_line_length 
+                        = comment_line ? strlen(comment_line) : 0,
 		.tokens         = {0},
         .token_table	= table,
 		.token_table_count
 						= table_len,
-        .skip_newline  = skip_nl
+        .keyword_table  = keywords,
+        .keyword_table_count
+                        = keywords_len,
+        .skip_newline  = skip_nl,
+        .scan           = tkn_scan_kernels(),
+        .threads        = 1,
 	};
 
+    return __tkn_matcher_build(t);
+}
+
+void TokenLines_free(TokenLines* l) {
+    free(l->items);
+    *l = (TokenLines) {0};
+}
+
+// index of the line that contains input offset
+size_t TokenLines_find(const TokenLines* l, size_t offset) {
+    // amount of lines that start at or before offset
+    size_t lo = 0, hi = l->count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (l->items[mid] <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// input offset of the line with index `line`, it has to be indexed already
+size_t TokenLines_start(const TokenLines* l, size_t line) {
+    assert(line <= l->count && "Line is not indexed");
+    return line ? l->items[line - 1] : 0;
+}
+
+// bytes [start, old_end) were replaced with [start, new_end) of `text`,
+// lines after the edit are moved instead of indexed again
+void TokenLines_edit(TokenLines* l, const char* text, size_t start, size_t old_end, size_t new_end) {
+    assert(l->indexed >= old_end && "Edit is past the indexed input");
+    // line starts are right after new line, so replaced ones are in (start, old_end]
+    const size_t from = TokenLines_find(l, start);
+    const size_t to   = TokenLines_find(l, old_end);
+    const long long delta = (long long) new_end - (long long) old_end;
+
+    size_t added = 0;
+    for(const char* it = text + start, *end = text + new_end; 
+        it < end && (it = memchr(it, '\n', end - it)); it++) added++;
+
+    const size_t count = l->count - (to - from) + added;
+    if (count > l->capacity) {
+        l->capacity = count * 2;
+        l->items = realloc(l->items, l->capacity * sizeof(*l->items));
+        assert(l->items && "Failed to grow line index");
+    }
+    memmove(l->items + from + added, l->items + to, (l->count - to) * sizeof(*l->items));
+    for(size_t i = from + added; i < count; i++) l->items[i] += delta;
+
+    size_t n = from;
+    for(const char* it = text + start, *end = text + new_end; 
+        it < end && (it = memchr(it, '\n', end - it)); it++) l->items[n++] = it + 1 - text;
+
+    l->count    = count;
+    l->indexed += delta;
+}
+
+void TokenSymbols_free(TokenSymbols* s) {
+    free(s->items);
+    free(s->slots);
+    *s = (TokenSymbols) {0};
+}
+
+static inline unsigned int __tkn_symbol_hash(const char* s, size_t len) {
+    unsigned int h = 2166136261u;
+    for(size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void __tkn_symbols_grow(TokenSymbols* s) {
+    const size_t count = s->slot_count ? s->slot_count * 2 : TOKENIZER_SYMBOLS_INITIAL_SLOTS;
+    free(s->slots);
+    s->slots      = calloc(count, sizeof(*s->slots));
+    s->slot_count = count;
+    assert(s->slots && "Failed to grow symbol table");
+
+    loop(i, s->count) {
+        size_t slot = s->items[i].hash & (count - 1);
+        while(s->slots[slot]) slot = (slot + 1) & (count - 1);
+        s->slots[slot] = i + 1;
+    }
+}
+
+// id of symbol with this text, `hash` is __tkn_symbol_hash of it.
+// new symbols keep `text` pointer, so it has to outlive the table
+unsigned int TokenSymbols_intern(TokenSymbols* s, const char* text, size_t length, unsigned int hash) {
+    if (2 * (s->count + 1) > s->slot_count) __tkn_symbols_grow(s);
+
+    const size_t mask = s->slot_count - 1;
+    size_t slot = hash & mask;
+    while(s->slots[slot]) {
+        const TokenSymbol* it = &s->items[s->slots[slot] - 1];
+        if (it->hash == hash && it->length == length && memcmp(it->text, text, length) == 0)
+            return s->slots[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+
+    TokenSymbol symbol = {
+        .text   = text,
+        .length = length,
+        .hash   = hash,
+    };
+    da_append(s, symbol);
+    s->slots[slot] = s->count;
+    return s->count - 1;
 }
 
 void Tokenizer_clear(Tokenizer* t) {
@@ -151,47 +417,390 @@ void Tokenizer_clear(Tokenizer* t) {
 void Tokenizer_free(Tokenizer* t) {
 	assert(t && "Tokenizer has to be valid");
     free(t->tokens.items);
+    t->tokens.items = NULL;
     t->tokens.count = 0;
     t->tokens.capacity = 32; // default capacity
+    if (t->owns_lines) {
+        TokenLines_free(t->lines);
+        free(t->lines);
+    }
+    t->lines = NULL;
+    t->owns_lines = false;
+    TokenSymbols_free(&t->symbols);
+    __tkn_pool_free(&t->detached);
+}
+
+// record line starts into `lines` instead of tokenizer's own index,
+// has to be done before anything is read
+void Tokenizer_track_lines(Tokenizer* t, TokenLines* lines) {
+    assert(!t->lines && "Tokenizer already has line index");
+    t->lines      = lines;
+    t->owns_lines = false;
 }
 
+// offset of current position in the whole input
+size_t Tokenizer_offset(const Tokenizer* t) {
+    return (t->stream ? t->stream->offset : 0) + t->position;
+}
 
+// record starts of lines in the bytes between `indexed` and end of 
+// what was read so far, both modes keep everything in the index
+void __tkn_lines_update(Tokenizer* t) {
+    if (!t->lines) {
+        t->lines      = calloc(1, sizeof(TokenLines));
+        t->owns_lines = true;
+        assert(t->lines && "Failed to allocate line index");
+    }
 
-bool Token_compare_cstr(Token t, const char* cstr) {
+    TokenLines*  lines  = t->lines;
+    const size_t base   = t->stream ? t->stream->offset : 0;
+    if (lines->indexed >= base + t->target_length) return;
+
+    const size_t from   = lines->indexed - base;
+    const size_t length = t->target_length - from;
+    const char*  it     = t->target + from;
+    const char*  end    = it + length;
+    const size_t needed = lines->count + t->scan->count(it, length, '\n');
+    if (needed > lines->capacity) {
+        lines->capacity = needed * 2;
+        lines->items = realloc(lines->items, lines->capacity * sizeof(*lines->items));
+        assert(lines->items && "Failed to grow line index");
+    }
+
+    while(it < end && (it = memchr(it, '\n', end - it))) {
+        it++;
+        lines->items[lines->count++] = base + (it - t->target);
+    }
+    lines->indexed = base + t->target_length;
+}
+
+// row (counted from first_row) and column (from 1) of input offset
+void Tokenizer_location(Tokenizer* t, size_t offset, size_t* row, size_t* col) {
+    if (!t->lines || offset >= t->lines->indexed) __tkn_lines_update(t);
+    const size_t line = TokenLines_find(t->lines, offset);
+    *row = t->first_row + line;
+    *col = offset - TokenLines_start(t->lines, line) + 1;
+}
+
+//
+// STREAMING
+//
+
+// blocks are never moved, so text stays valid for as long as pool lives.
+// returns reference, that fits into Token.aux (see __tkn_pool_get)
+unsigned int __tkn_pool_put(TokenPool* p, const char* data, size_t length) {
+    const bool fits = p->count && p->used + length <= TOKENIZER_POOL_BLOCK_SIZE;
+
+    if (!fits) {
+        // oversized text gets its own block, that is full right away
+        size_t size = MAX(length, TOKENIZER_POOL_BLOCK_SIZE);
+        da_append(p, malloc(size));
+        p->used = 0;
+    }
+
+    const size_t block = p->count - 1;
+    assert(block < (unsigned int) -1 / TOKENIZER_POOL_BLOCK_SIZE && "Token pool is full");
+    memcpy(p->items[block] + p->used, data, length);
+    const unsigned int ref = block * TOKENIZER_POOL_BLOCK_SIZE + p->used;
+    p->used += length;
+    return ref;
+}
+
+const char* __tkn_pool_get(const TokenPool* p, unsigned int ref) {
+    return p->items[ref / TOKENIZER_POOL_BLOCK_SIZE] + ref % TOKENIZER_POOL_BLOCK_SIZE;
+}
+
+void __tkn_pool_free(TokenPool* p) {
+    loop(i, p->count) free(p->items[i]);
+    free(p->items);
+    *p = (TokenPool) {0};
+}
+
+// drop consumed part of the window and read until it is full or input ends,
+// returns amount of newly read bytes
+size_t __tkn_stream_refill(Tokenizer* t) {
+    TokenizerStream* s = t->stream;
+    size_t keep = t->target_length - t->position;
+
+    if (s->eof) return 0;
+
+    // token that straddles the boundary is bigger then window
+    if (t->position == 0 && keep == s->capacity) {
+        s->capacity *= 2;
+        s->window = realloc(s->window, s->capacity);
+        assert(s->window && "Failed to grow tokenizer window");
+    } else {
+        memmove(s->window, s->window + t->position, keep);
+        s->offset += t->position;
+    }
+
+    size_t added = 0;
+    while(keep + added < s->capacity) {
+        size_t n = s->read(s->user, s->window + keep + added, s->capacity - keep - added);
+        if (n == 0) {
+            s->eof = true;
+            break;
+        }
+        added += n;
+    }
+
+    t->target        = s->window;
+    t->target_length = keep + added;
+    t->position      = 0;
+    assert(s->offset + t->target_length < (unsigned int) -1 && "Input is too big for 32 bit token offsets");
+    // window forgets consumed bytes, so index lines right away
+    __tkn_lines_update(t);
+    return added;
+}
+
+// keep at least a lookahead worth of bytes in front of position
+void __tkn_stream_prefetch(Tokenizer* t) {
+    if (t->stream && 
+        !t->stream->eof && 
+        t->target_length - t->position < TOKENIZER_STREAM_LOOKAHEAD)
+        __tkn_stream_refill(t);
+}
+
+// true if token that ends at `end` may continue in not yet read input
+bool __tkn_stream_straddles(const Tokenizer* t, size_t end) {
+    return t->stream && !t->stream->eof && end >= t->target_length;
+}
+
+// switch tokenizer to pull input through `read`
+void Tokenizer_stream(Tokenizer* t, TokenizerStream* s, TokenizerReadFn read, void* user) {
+    assert(t && s && read);
+    *s = (TokenizerStream) {
+        .read       = read,
+        .user       = user,
+        .capacity   = TOKENIZER_STREAM_WINDOW,
+        .window     = malloc(TOKENIZER_STREAM_WINDOW),
+    };
+    t->stream        = s;
+    t->target        = s->window;
+    t->target_length = 0;
+    t->position      = 0;
+}
+
+// point tokenizer at another version of input. Interned words keep text
+// of their first occurrence, ones that are in the old input get copied out
+void Tokenizer_retarget(Tokenizer* t, const char* target, size_t length) {
+    assert(!t->stream && "Streaming tokenizer can not be retargeted");
+    assert(length < (unsigned int) -1 && "Input is too big for 32 bit token offsets");
+
+    const char* begin = t->target;
+    const char* end   = t->target + t->target_length;
+    loop(i, t->symbols.count) {
+        TokenSymbol* symbol = &t->symbols.items[i];
+        if (symbol->text >= begin && symbol->text < end)
+            symbol->text = __tkn_pool_get(&t->detached, 
+                    __tkn_pool_put(&t->detached, symbol->text, symbol->length));
+    }
+    t->target           = target;
+    t->target_length    = length;
+    t->position         = 0;
+}
+
+void Tokenizer_stream_free(TokenizerStream* s) {
+    free(s->window);
+    __tkn_pool_free(&s->pool);
+    *s = (TokenizerStream) {0};
+}
+
+
+
+static inline bool __tkn_is_number_kind(int kind) {
+    return kind == TokenKind_literall_integer || kind == TokenKind_literall_float;
+}
+
+// text of word or string, numbers and symbols are only in window 
+// while it is still there when streaming
+TknSlice Tokenizer_text(const Tokenizer* t, Token tok) {
+    TknSlice result = { .length = tok.length };
+    if (__tkn_is_number_kind(tok.kind))
+        // length holds the value, see __tkn_set_value
+        result.length = 0;
+    else if (tok.flags & TokenFlag_symbol)
+        result.data = t->symbols.items[tok.aux].text;
+    else if (tok.flags & TokenFlag_table)
+        result.data = t->token_table[tok.aux].txt;
+    else if (tok.flags & TokenFlag_pooled)
+        result.data = __tkn_pool_get(&t->stream->pool, tok.aux);
+    else if (!t->stream)
+        result.data = t->target + tok.offset;
+    else if (tok.offset >= t->stream->offset && 
+             tok.offset + tok.length <= t->stream->offset + t->target_length)
+        result.data = t->target + (tok.offset - t->stream->offset);
+    else
+        result.length = 0;
+    return result;
+}
+
+symbol_t Token_symbol(Token t) {
+    return (symbol_t) t.aux;
+}
+
+// 64 bit literal value is split between length (low) and aux (high),
+// text length of numbers is not kept
+void __tkn_set_value(Token* t, unsigned long long bits) {
+    t->length = (unsigned int) bits;
+    t->aux    = (unsigned int) (bits >> 32);
+}
+
+unsigned long long __tkn_get_value(Token t) {
+    return (unsigned long long) t.aux << 32 | t.length;
+}
+
+long long Token_int(Token t) {
+    return (long long) __tkn_get_value(t);
+}
+
+double Token_float(Token t) {
+    unsigned long long bits = __tkn_get_value(t);
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+bool Token_compare_cstr(const Tokenizer* t, Token tok, const char* cstr) {
     const size_t len = strlen(cstr);
-    return (t.kind == TokenKind_word || t.kind == TokenKind_literall_string ) &&
-        t.data.as_word.length == len &&
-        (strncmp(t.data.as_word.data,cstr, len) == 0)
-    ;
+    if (!(tok.kind == TokenKind_word || tok.kind == TokenKind_literall_string) || tok.length != len)
+        return false;
+    TknSlice text = Tokenizer_text(t, tok);
+    return text.data && strncmp(text.data, cstr, len) == 0;
+}
+
+// keywords hash apart from operators, so both can be spelled the same
+static inline unsigned int __tkn_hash(unsigned int seed, const char* s, size_t len, bool is_keyword) {
+    unsigned int h = 2166136261u ^ seed ^ (unsigned int)len ^ (is_keyword ? 0x9E3779B9u : 0);
+    for(size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    return (h ^ (h >> 15)) & (TOKENIZER_HASH_SIZE - 1);
 }
 
-bool __tkn_cmp_from(
-		TknSlice 	s, 
-		const char* src, 
-		size_t 		space_left)
-{
-	bool overflow = s.length > space_left; // "Attempt to overflow src"
-	return !overflow && (strncmp(s.data,src,s.length) == 0);
+bool __tkn_matcher_place(TokenMatcher* m, unsigned int seed, const TokenTableEntry* e, bool is_keyword) {
+    const size_t len = strlen(e->txt);
+    TokenMatcherSlot* slot = &m->slots[__tkn_hash(seed, e->txt, len, is_keyword)];
+    if (slot->entry) return false;
+    *slot = (TokenMatcherSlot) {
+        .entry      = e,
+        .length     = len,
+        .is_keyword = is_keyword,
+    };
+    return true;
+}
+
+// entry spelled the same as an earlier one of its table, it is never
+// matched, first entry wins as it did with linear lookup
+bool __tkn_matcher_shadowed(const TokenTableEntry* table, size_t i) {
+    loop(j, i) if (strcmp(table[j].txt, table[i].txt) == 0) return true;
+    return false;
+}
+
+// build first byte dispatch and search for a seed that makes
+// hash collision free across all multi byte entries. False when
+// there is none, matcher is not usable then
+bool __tkn_matcher_build(Tokenizer* t) {
+    TokenMatcher* m = &t->matcher;
+    memset(m, 0, sizeof(*m));
+
+    loop(i, t->token_table_count) {
+        const TokenTableEntry* e = &t->token_table[i];
+        const size_t len = strlen(e->txt);
+        const unsigned char first = e->txt[0];
+        if (len == 0 || len > TOKENIZER_MAX_ENTRY_LENGTH) return false;
+
+        if (len == 1) {
+            // first entry wins, same as with linear lookup
+            if (!m->single[first]) m->single[first] = i + 1;
+        } else
+            m->multi[first] |= 1 << (len - 2);
+    }
+
+    m->keyword_min = TOKENIZER_MAX_ENTRY_LENGTH;
+    loop(i, t->keyword_table_count) {
+        const size_t len = strlen(t->keyword_table[i].txt);
+        if (len == 0 || len > TOKENIZER_MAX_ENTRY_LENGTH) return false;
+        m->keyword_min = MIN(m->keyword_min, len);
+        m->keyword_max = MAX(m->keyword_max, len);
+    }
+
+    // entries that can be matched, duplicates are dropped
+    const TokenTableEntry* placed[TOKENIZER_HASH_SIZE];
+    bool   is_keyword[TOKENIZER_HASH_SIZE];
+    size_t count = 0;
+    loop(i, t->token_table_count) {
+        if (strlen(t->token_table[i].txt) < 2 || __tkn_matcher_shadowed(t->token_table, i)) continue;
+        if (count == TOKENIZER_HASH_SIZE) return false;
+        placed[count] = &t->token_table[i];
+        is_keyword[count++] = false;
+    }
+    loop(i, t->keyword_table_count) {
+        if (__tkn_matcher_shadowed(t->keyword_table, i)) continue;
+        if (count == TOKENIZER_HASH_SIZE) return false;
+        placed[count] = &t->keyword_table[i];
+        is_keyword[count++] = true;
+    }
+
+    for(unsigned int seed = 0; seed < TOKENIZER_MAX_SEED; seed++) {
+        bool ok = true;
+        memset(m->slots, 0, sizeof(m->slots));
+        loop(i, count) {
+            if (!__tkn_matcher_place(m, seed, placed[i], is_keyword[i])) { ok = false; break; }
+        }
+        if (ok) {
+            m->seed = seed;
+            return true;
+        }
+    }
+    memset(m->slots, 0, sizeof(m->slots));
+    return false;
+}
+
+const TokenTableEntry* __tkn_matcher_lookup(const TokenMatcher* m, const char* s, size_t len, bool is_keyword) {
+    const TokenMatcherSlot* slot = &m->slots[__tkn_hash(m->seed, s, len, is_keyword)];
+    if (slot->entry && 
+        slot->length == len && 
+        slot->is_keyword == is_keyword &&
+        memcmp(slot->entry->txt, s, len) == 0)
+        return slot->entry;
+    return NULL;
 }
 
+// longest operator or single symbol from the table at current position
+const TokenTableEntry* __tkn_match_table(const Tokenizer* t, size_t* length) {
+    const TokenMatcher* m = &t->matcher;
+	const size_t space_left = t->target_length - t->position;
+	const char* now = t->target + t->position;
+    const unsigned char first = *now;
+    unsigned int lengths = m->multi[first];
+
+    while(lengths) {
+        // highest bit first, the longest operator wins
+        int bit = 31 - __builtin_clz(lengths);
+        size_t len = bit + 2;
+        lengths &= ~(1u << bit);
+
+        if (len > space_left) continue;
+        const TokenTableEntry* e = __tkn_matcher_lookup(m, now, len, false);
+        if (e) {
+            *length = len;
+            return e;
+        }
+    }
 
-index_t __tkn_match_table(Tokenizer t) {
-	index_t token_i = INVALID_INDEX;
-	const size_t space_left = t.target_length - t.position;
-	const char* now = t.target + t.position;
-	loop(i, t.token_table_count) {
-		TokenTableEntry entry = t.token_table[i];
-		TknSlice slice = {
-			MUTCSTR(entry.txt) ,
-			strlen(entry.txt)
-		};
+    if (m->single[first]) {
+        *length = 1;
+        return &t->token_table[m->single[first] - 1];
+    }
+	return NULL;
+}
 
-		if (__tkn_cmp_from(slice, now, space_left)) {
-			token_i = i;
-			break;
-		}
-	}
-	return token_i;
+const TokenTableEntry* __tkn_match_keyword(const Tokenizer* t, const char* word, size_t length) {
+    const TokenMatcher* m = &t->matcher;
+    if (length < m->keyword_min || length > m->keyword_max) return NULL;
+    return __tkn_matcher_lookup(m, word, length, true);
 }
 
 unsigned int stoi(const char* str) {
@@ -222,96 +831,194 @@ bool __is_decimal(unsigned char c) {
 
 
 
-Token __tkn_get_word(Tokenizer t, size_t* step_sz) {
-	const char* word = (t.target + t.position);
+Token __tkn_get_word(const Tokenizer* t, size_t* step_sz) {
+	const char* word = (t->target + t->position);
 	Token result = {
 		.kind = TokenKind_word,
 		.id = 0,
-		.data.as_word = {
-			.data = MUTCSTR(word),
-			.length = 0
-		}
 	};
 
-	for(size_t i = t.position; i < t.target_length; i++) {
-		const char  symbol = *word;
-		if (__is_character(symbol) || __is_decimal(symbol)) 
-			result.data.as_word.length++;
-		else
-			break;
-		
-		word++;
-		(*step_sz)++;
-	}
+    const size_t length = 
+        t->scan->run[TKN_SCAN_IDENT](word, t->target_length - t->position);
+    result.length = length;
+    (*step_sz) += length;
+
+    const TokenTableEntry* keyword = __tkn_match_keyword(t, word, length);
+    if (keyword) result.id = keyword->id;
 
 	return result;
 }
 
-Token __tkn_get_number(Tokenizer t, size_t* step_sz) {
-	static char scratch[TEMP_CSTR_LENGTH];
-	const char* word = (t.target + t.position);
+// value of hex digit, 16 or more if it is not one
+static inline unsigned int __tkn_digit_value(unsigned char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return 16;
+}
+
+// numbers with more significant digits go through strtod
+#define TOKENIZER_NUMBER_DIGITS 19
+#ifndef TOKENIZER_NUMBER_MAX_LENGTH
+#	define TOKENIZER_NUMBER_MAX_LENGTH 512
+#endif
+
+// digits * 10^exponent, exact when digits fit into double mantissa
+// and power of ten is exact too (Clinger's fast path), otherwise
+// strtod gets only digits and exponent, so there is no locale involved
+double __tkn_decimal_to_double(const char* s, size_t length, unsigned long long mantissa, int exponent, bool truncated) {
+    static const double powers[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+    if (mantissa == 0) return 0.0;
+    if (!truncated && mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22)
+        return (exponent < 0) ? (double) mantissa / powers[-exponent] : (double) mantissa * powers[exponent];
+
+    // digits past the buffer only scale the number, digits after dot
+    // that made it into buffer move the exponent down
+    char      buffer[TOKENIZER_NUMBER_MAX_LENGTH + 16];
+    size_t    count = 0, i = 0;
+    long long e = 0;
+    bool      fraction = false;
+    for(; i < length && (s[i] | 0x20) != 'e'; i++) {
+        if (s[i] == '.') fraction = true;
+        if (s[i] < '0' || s[i] > '9') continue;
+        if (count < TOKENIZER_NUMBER_MAX_LENGTH) {
+            buffer[count++] = s[i];
+            e -= fraction;
+        } else 
+            e += !fraction;
+    }
+    if (i < length) e += strtol(s + i + 1, NULL, 10);
+    snprintf(buffer + count, 16, "e%lld", e);
+    return strtod(buffer, NULL);
+}
+
+// decimal, float with fraction and/or exponent, or hex integer,
+// digits can be separated with underscores. value is decoded in place
+Token __tkn_get_number(const Tokenizer* t, size_t* step_sz) {
+	const char*  s = (t->target + t->position);
+    const size_t n = t->target_length - t->position;
 	Token result = {
 		.id = 0,
-		.data.as_word = {
-			.data 	= MUTCSTR(word),
-			.length = 0
-		}
+        .kind = TokenKind_literall_integer,
 	};
-	size_t dot_count = 0;
-
-	for(size_t i = t.position; i < t.target_length; i++) {
-		const char  symbol = *word;
-		bool is_only_dot = (symbol == '.' && dot_count <= 1);
-		if (__is_decimal(symbol) || is_only_dot) {
-			result.data.as_word.length++;
-			if (symbol == '.')
-				dot_count++;
-		}
-		else
-			break;
-		
-		word++;
-		(*step_sz)++;
-	}
-	// decide if float or not
-	// perform conversion
-	memset(scratch,0,TEMP_CSTR_LENGTH);
-	strncpy(scratch, 
-			result.data.as_word.data,
-			result.data.as_word.length
-	);
-	result = (Token) {0};
-
-	if (dot_count > 0) {
-		result.kind = TokenKind_literall_float;
-		result.data.as_float = atof(scratch);
-	} else {
-		result.kind = TokenKind_literall_integer;
-		result.data.as_int = atoi(scratch);
-	}
+    unsigned long long mantissa = 0;
+    int    digits    = 0;       // significant digits in mantissa
+    int    exponent  = 0;
+    bool   truncated = false;   // some non zero digits did not fit
+    bool   is_float  = false;
+    size_t i = 0;
+
+    // digits past 64 bits only scale the value, lowest bit stays set
+    // when any of them was non zero so the conversion rounds right
+    if (n > 2 && s[0] == '0' && (s[1] | 0x20) == 'x' && __tkn_digit_value(s[2]) < 16) {
+        int shift = 0;
+        for(i = 2; i < n; i++) {
+            const unsigned int v = __tkn_digit_value(s[i]);
+            if (s[i] == '_') continue;
+            if (v >= 16) break;
+            if (mantissa >> 60) {
+                shift += 4;
+                truncated |= (v != 0);
+            } else
+                mantissa = mantissa << 4 | v;
+        }
+        (*step_sz) += i;
+
+        // same as decimals, integers that do not fit into 63 bits become floats
+        if (shift || mantissa > (unsigned long long) LLONG_MAX) {
+            double value = (double) (mantissa | truncated);
+            for(; shift > 0; shift -= 4) value *= 16.0;
+            unsigned long long bits;
+            memcpy(&bits, &value, sizeof(bits));
+            result.kind = TokenKind_literall_float;
+            __tkn_set_value(&result, bits);
+        } else
+            __tkn_set_value(&result, mantissa);
+        return result;
+    }
+
+    for(; i < n; i++) {
+        const unsigned int d = (unsigned char) s[i] - '0';
+        if (s[i] == '_') continue;
+        if (d > 9) break;
+        if (digits < TOKENIZER_NUMBER_DIGITS) {
+            mantissa = mantissa * 10 + d;
+            digits  += (mantissa != 0);
+        } else {
+            exponent++;
+            truncated |= (d != 0);
+        }
+    }
+
+    // dot belongs to the number only if digit follows, so `0..10` is a range
+    if (i + 1 < n && s[i] == '.' && s[i + 1] >= '0' && s[i + 1] <= '9') {
+        is_float = true;
+        for(i++; i < n; i++) {
+            const unsigned int d = (unsigned char) s[i] - '0';
+            if (s[i] == '_') continue;
+            if (d > 9) break;
+            if (digits < TOKENIZER_NUMBER_DIGITS) {
+                mantissa = mantissa * 10 + d;
+                digits  += (mantissa != 0);
+                exponent--;
+            } else 
+                truncated |= (d != 0);
+        }
+    }
+
+    if (i < n && (s[i] | 0x20) == 'e') {
+        size_t j = i + 1;
+        int    sign = 1, value = 0;
+        if (j < n && (s[j] == '+' || s[j] == '-')) sign = (s[j++] == '-') ? -1 : 1;
+        if (j < n && s[j] >= '0' && s[j] <= '9') {
+            for(; j < n && s[j] >= '0' && s[j] <= '9'; j++)
+                if (value < 100000) value = value * 10 + (s[j] - '0');
+            exponent += sign * value;
+            is_float  = true;
+            i = j;
+        }
+    }
+    (*step_sz) += i;
+
+    // integers that do not fit into 63 bits become floats
+    if (!is_float && (truncated || exponent || mantissa > (unsigned long long) LLONG_MAX))
+        is_float = true;
+
+    if (is_float) {
+        double value = __tkn_decimal_to_double(s, i, mantissa, exponent, truncated);
+        unsigned long long bits;
+        memcpy(&bits, &value, sizeof(bits));
+        result.kind = TokenKind_literall_float;
+        __tkn_set_value(&result, bits);
+    } else {
+        __tkn_set_value(&result, mantissa);
+    }
 
 	return result;
 }
 
 
-Token __tkn_get_string_literall(Tokenizer t, symbol_t quotations[2], size_t* step_sz) {
+Token __tkn_get_string_literall(const Tokenizer* t, symbol_t quotations[2], size_t* step_sz) {
 	const size_t QOPEN	= 0;
 	const size_t QCLOSE = 1;
-	const char* word = (t.target + t.position);
+	const char* word = (t->target + t->position);
 	bool inside_string	= false;
+	// text starts after opening quote
 	Token result = {
 		.id = 0,
 		.kind = TokenKind_literall_string,
-		.data.as_word = {
-			.data 	= MUTCSTR(word+1),
-			.length = 0
-		}
 	};
 
-	for(size_t i = t.position; i < t.target_length; i++) {
+	// escapes move by two, so bound is checked on the pointer itself
+	const char* end = t->target + t->target_length;
+	while(word < end) {
 		
 		const char  symbol 		= *word;
-		const char  next_symbol = (i+1 < t.target_length)?  *(word+1) : 0;
+		const char  next_symbol = (word+1 < end)?  *(word+1) : 0;
 		bool is_qopen 	= (symbol == quotations[QOPEN]);
 		bool is_qclose  = (symbol == quotations[QCLOSE]);
 		bool is_backslh = (symbol == '\\');
@@ -330,11 +1037,11 @@ Token __tkn_get_string_literall(Tokenizer t, symbol_t quotations[2], size_t* ste
 			if (next_symbol == quotations[QCLOSE]) {
 				word+=2;
 				(*step_sz)+=2;
-				result.data.as_word.length+=2;
+				result.length+=2;
 				continue;
 			}
 
-		result.data.as_word.length++;
+		result.length++;
 		word++;
 		(*step_sz)++;
 	}
@@ -355,40 +1062,37 @@ typedef enum {
 
 typedef unsigned char bitmask8_t;
 
-const char* __tkn_temp_cstr(Token t, bitmask8_t print_flags) {
-	static char token	[TEMP_CSTR_LENGTH*3];
-	static char cstr	[TEMP_CSTR_LENGTH];
-	static char number	[TEMP_CSTR_LENGTH];
-
-	// reset
-	memset(token,0,TEMP_CSTR_LENGTH);
-	memset(cstr,0,TEMP_CSTR_LENGTH);
-	memset(number,0,TEMP_CSTR_LENGTH);
+// prints token into `out`, text is cut to fit TEMP_CSTR_LENGTH
+const char* __tkn_temp_cstr(Token t, TknSlice text, bitmask8_t print_flags, char* out, size_t capacity) {
+	char cstr	[TEMP_CSTR_LENGTH] = {0};
+	char number	[TEMP_CSTR_LENGTH] = {0};
+    const size_t text_length = 
+        (text.length < TEMP_CSTR_LENGTH - 3) ? text.length : TEMP_CSTR_LENGTH - 3;
 
 	switch(t.kind) {
 		case TokenKind_null:
 			strcpy(cstr, "(null)"); 
 			break;
 		case TokenKind_symbol:
-			sprintf(cstr, "'%c'", t.data.as_symbol); 
+			sprintf(cstr, "'%c'", Token_symbol(t)); 
 			break;
 		case TokenKind_word:
-			strncpy(cstr, t.data.as_word.data, t.data.as_word.length);
+			memcpy(cstr, text.data, text_length);
 			break;
 		case TokenKind_literall_integer:
 			snprintf(cstr,
 					TEMP_CSTR_LENGTH,
-					"%i",t.data.as_int);
+					"%lli",Token_int(t));
 			break;
 		case TokenKind_literall_float:
 			snprintf(cstr,
 					TEMP_CSTR_LENGTH,
-					"%f",t.data.as_float);
+					"%f",Token_float(t));
 			break;
 		case TokenKind_literall_string:
 			{
 				strcat(cstr,"\"");
-				strncat(cstr, t.data.as_word.data, MIN(t.data.as_word.length,TEMP_CSTR_LENGTH-2));
+				strncat(cstr, text.data, text_length);
 				strcat(cstr,"\"");
 			}
 			break;
@@ -403,9 +1107,6 @@ const char* __tkn_temp_cstr(Token t, bitmask8_t print_flags) {
 	}
 
 	const size_t half_capacity		= TEMP_CSTR_LENGTH/2;
-	//const size_t capacity			= TEMP_CSTR_LENGTH;
-	//const size_t double_capacity 	= TEMP_CSTR_LENGTH*2;
-	const size_t triple_capacity	= TEMP_CSTR_LENGTH*3;
 
 	const bool 
 		use_curly = print_flags & TokenizerPrintFlag_wrap_in_curly,
@@ -421,7 +1122,7 @@ const char* __tkn_temp_cstr(Token t, bitmask8_t print_flags) {
 	snprintf(kind_str, half_capacity, "%i",t.kind);
 	snprintf(id_str, half_capacity, "%i",t.id);
 	
-	snprintf(token,triple_capacity,"%s %s%s%s%s%s%s%s%s %s",
+	snprintf(out,capacity,"%s %s%s%s%s%s%s%s%s %s",
 			(use_curly) ? "{" : "",
 
 			(show_text) ? 	TOKENIZER_TOKEN_FMT_CONTENT : "",	
@@ -437,146 +1138,433 @@ const char* __tkn_temp_cstr(Token t, bitmask8_t print_flags) {
 			
 			(use_curly) ? "}" : ""
 	);
-	return token;
+	return out;
 }
 
-const char* Token_temp_cstr(Token t)  {
-	return __tkn_temp_cstr(t,0xFF);
+// result is valid until next call with the same tokenizer
+const char* Token_temp_cstr(Tokenizer* lexer, Token t)  {
+	return __tkn_temp_cstr(t,Tokenizer_text(lexer,t),0xFF,
+            lexer->scratch_buffer, sizeof(lexer->scratch_buffer));
 }
 
-const char* Token_text_cstr(Token t)  {
-	return __tkn_temp_cstr(t,TokenizerPrintFlag_display_text);
+const char* Token_text_cstr(Tokenizer* lexer, Token t)  {
+	return __tkn_temp_cstr(t,Tokenizer_text(lexer,t),TokenizerPrintFlag_display_text,
+            lexer->scratch_buffer, sizeof(lexer->scratch_buffer));
 }
 
-Token Tokenizer_next_token(Tokenizer* t) {
-	Token 	result = {0};
-	index_t table_i = INVALID_INDEX;
-	size_t 	step_size = 0;
+bool __tkn_starts_with_at(const Tokenizer* t, size_t position, const char* str, size_t len) {
+    const char* now = t->target + position;
+    return 
+        len && 
+        *now == *str && 
+        len <= t->target_length - position && 
+        memcmp(now, str, len) == 0;
+}
 
-    enum { 
-        NO_COMMENT,
-        BLOCK_COMMENT,
-        LINE_COMMENT
-    };
+bool __tkn_starts_with(const Tokenizer* t, const char* str, size_t len) {
+    return __tkn_starts_with_at(t, t->position, str, len);
+}
+
+// jump between candidate bytes of closing delimiter with memchr
+// and compare the whole delimiter only there
+void __tkn_skip_block_comment(Tokenizer* t) {
+    const char*  close      = t->comment_block[1];
+    const size_t close_len  = t->comment_block_length[1];
+    size_t       from       = t->position + t->comment_block_length[0];
+
+    for(;;) {
+        const char* end = t->target + t->target_length;
+        const char* it  = t->target + from;
+
+        while(it < end && (it = memchr(it, close[0], end - it))) {
+            if ((size_t)(end - it) >= close_len && memcmp(it, close, close_len) == 0) {
+                t->position = (it - t->target) + close_len;
+                return;
+            }
+            it++;
+        }
+
+        // keep only bytes that can still be start of the delimiter
+        size_t tail = (t->target_length > close_len - 1) ? t->target_length - (close_len - 1) : 0;
+        if (!__tkn_stream_straddles(t, t->target_length)) 
+            break;
+        if (tail < t->position) 
+            tail = t->position;
+        t->position = tail;
+        from = (from > tail) ? from - tail : 0;
+        __tkn_stream_refill(t);
+    }
+
+    // unterminated comment eats everything
+    t->position = t->target_length;
+}
+
+// line comment ends right before new line, so it still produces EOL
+void __tkn_skip_line_comment(Tokenizer* t) {
+    for(;;) {
+        const char* now = t->target + t->position;
+        const char* eol = memchr(now, '\n', t->target_length - t->position);
+        size_t stop = eol ? (size_t)(eol - t->target) : t->target_length;
+        t->position = stop;
+
+        if (eol || !__tkn_stream_straddles(t, stop)) return;
+        __tkn_stream_refill(t);
+    }
+}
+
+// window moves when streaming, so new symbols get their text from pool
+void __tkn_intern_word(Tokenizer* t, Token* tok, const char* text) {
+    TokenSymbols* s    = &t->symbols;
+    const unsigned int hash = __tkn_symbol_hash(text, tok->length);
+    const size_t before = s->count;
+
+    tok->aux    = TokenSymbols_intern(s, text, tok->length, hash);
+    tok->flags |= TokenFlag_symbol;
 
-    static int comment = NO_COMMENT;
-    const char* cb_open = t->comment_block[0];
-    const char* cb_close = t->comment_block[1];
+    if (t->stream && s->count != before) {
+        TokenSymbol* symbol = &s->items[tok->aux];
+        symbol->text = __tkn_pool_get(&t->stream->pool, 
+                __tkn_pool_put(&t->stream->pool, text, tok->length));
+    }
+}
 
+Token Tokenizer_next_token(Tokenizer* t) {
+	Token 	result = {0};
+    const TokenTableEntry* entry = NULL;
+    size_t  entry_size = 0;
+	size_t 	step_size = 0;
 
 retry:;
+    __tkn_stream_prefetch(t);
 	const char* leftover = (t->target + t->position);
 	const symbol_t current_symbol = *leftover;
-    
-// TODO: implement short-circuiting for this to improve performance of parsing
-    //bool is_bc_char = cb_close[0] == current_symbol;
-    bool is_bc_str = strncmp(leftover, cb_close, strlen(cb_close)) == 0;
+    const size_t start = t->position;
 
 	if(t->position < t->target_length) {
-		table_i = __tkn_match_table(*t);
-
 		//printf("\nmatching: {%s}", leftover);
 
-        if (comment) {
-            
-            if(!is_bc_str)  {
-                t->position += 1;
-                goto retry;
-            }
-
-            t->position += strlen(cb_close);
-            comment = NO_COMMENT;
+        if (__tkn_starts_with(t, t->comment_block[0], t->comment_block_length[0])) {
+            __tkn_skip_block_comment(t);
             goto retry;
         }
 
-        else if (strncmp(leftover, cb_open, strlen(cb_open)) == 0) {
-            t->position += strlen(cb_open);
-            comment = BLOCK_COMMENT;
+        else if (__tkn_starts_with(t, t->comment_line, t->comment_line_length)) {
+            __tkn_skip_line_comment(t);
             goto retry;
         }
 
-        // symbol/keyword exists in tokenization table
-        else if (table_i != INVALID_INDEX) {
-			TokenTableEntry e = t->token_table[table_i];
-			size_t			esz = strlen(e.txt);
+        // symbol exists in tokenization table
+        else if ((entry = __tkn_match_table(t, &entry_size))) {
+			TokenTableEntry e = *entry;
+			size_t			esz = entry_size;
 			
 			result.id = e.id;
-			result.kind = esz > 1 
-				? TokenKind_word : TokenKind_symbol;
+			result.length = esz;
 			
 			if (esz > 1) {
 				result.kind = TokenKind_word;
-				result.data.as_word = (TknSlice) {
-                    .data = e.txt,
-                    .length = esz
-                };
+				result.flags = TokenFlag_table;
+				result.aux = entry - t->token_table;
 			} else {
 				result.kind = TokenKind_symbol;
-				result.data.as_symbol = e.txt[0];
+				result.aux = (symbol_t) e.txt[0];
 			}
 
 			t->position += esz;
-            t->col += esz;
 		}
 
 
 		else if (__is_character(current_symbol)) 
-			result = __tkn_get_word(*t,&step_size);
+			result = __tkn_get_word(t,&step_size);
+
+		else if (__is_decimal(current_symbol)) 
+			result = __tkn_get_number(t,&step_size);
+	
+		else if (current_symbol == t->string_quotes[0]) {
+			result = __tkn_get_string_literall(t,t->string_quotes,&step_size);
+		}
+
+		else if (__is_eol(current_symbol)) {
+			result.kind = TokenKind_EOL;
+			result.length = 1;
+			t->position++;
+            if (t->skip_newline) goto retry;
+		}
+
+		else if (__is_space(current_symbol)) {
+			// skip until symbol is not space
+            size_t run = t->scan->run[TKN_SCAN_SPACE](
+                    leftover, t->target_length - t->position);
+            t->position += run;
+            goto retry;
+		}
+        else 
+            // TODO:
+            assert(0 && "Uknown to the tokenizer symbol");
+            //result = (Token) {0};
+        
+        if (step_size && t->stream) {
+            // token reached end of the window, read more and lex it again.
+            // numbers look up to 3 bytes past their end (`.5`, `e+5`)
+            const size_t look = __tkn_is_number_kind(result.kind) ? 3 : 0;
+            if (__tkn_stream_straddles(t, t->position + step_size + look)) {
+                __tkn_stream_refill(t);
+                step_size = 0;
+                result = (Token) {0};
+                goto retry;
+            }
+            if (result.kind == TokenKind_literall_string) {
+                result.aux    = __tkn_pool_put(&t->stream->pool, t->target + start + 1, result.length);
+                result.flags |= TokenFlag_pooled;
+            }
+        }
+
+        if (result.kind == TokenKind_word && !(result.flags & TokenFlag_table))
+            __tkn_intern_word(t, &result, t->target + start);
+
+		t->position += step_size;
+
+        // string text starts after the opening quote
+        result.offset = (t->stream ? t->stream->offset : 0) + start + 
+            (result.kind == TokenKind_literall_string);
+		step_size = 0; // reset each time
+	}
+
+	// if we exausted a target string
+	// return EOF
+	else {
+		result.kind = TokenKind_EOF;
+        result.offset = Tokenizer_offset(t);
+    }
+
+	return result;
+}
+
+#ifdef DT_TOKENIZER_THREADS
+void Tokenizer_run_parallel(Tokenizer* t, size_t threads);
+#endif
+
+// run tokenizer and save everything into growable stack
+void Tokenizer_run(Tokenizer* t) {
+#ifdef DT_TOKENIZER_THREADS
+    if (t->threads > 1 && !t->stream && 
+        t->target_length - t->position >= 2 * TOKENIZER_PARALLEL_MIN_CHUNK) {
+        Tokenizer_run_parallel(t, t->threads);
+        return;
+    }
+#endif
+	Token token = {0};
+	Tokens* s = &(t->tokens);
+	while( (token = Tokenizer_next_token(t)).kind != TokenKind_EOF ) {
+		da_append(s,token);
+	}
+}
+
+//
+// PARALLEL
+//
+// Input is cut at new lines that are outside of strings and comments,
+// so every chunk starts in the same state as at the beginning of a line.
+// Chunks are lexed by private copies of the tokenizer (they share only
+// input and tables, which are read only), then concatenated. Tokens keep
+// offsets into the whole input, so nothing has to be fixed up after.
+//
+
+// position of first byte that may open a string or a comment, or `end`
+static inline size_t __tkn_next_opener(const Tokenizer* t, size_t* next, size_t position, size_t end) {
+    const char openers[3] = { 
+        t->string_quotes[0], 
+        t->comment_block[0][0], 
+        t->comment_line_length ? t->comment_line[0] : t->string_quotes[0],
+    };
+    size_t first = end;
+
+    loop(i, 3) {
+        if (next[i] == INVALID_INDEX || next[i] < position) {
+            const char* it = memchr(t->target + position, openers[i], end - position);
+            next[i] = it ? (size_t)(it - t->target) : end;
+        }
+        if (next[i] < first) first = next[i];
+    }
+    return first;
+}
+
+// same rules as __tkn_get_string_literall, returns position after closing quote
+size_t __tkn_split_skip_string(const Tokenizer* t, size_t position, size_t end) {
+    const char* s = t->target;
+    for(position++; position < end; position++) {
+        if (s[position] == t->string_quotes[1]) 
+            return position + 1;
+        if (s[position] == '\\' && position + 1 < end && s[position + 1] == t->string_quotes[1])
+            position++;
+    }
+    return end;
+}
+
+size_t __tkn_split_skip_block_comment(const Tokenizer* t, size_t position, size_t end) {
+    const char*  close      = t->comment_block[1];
+    const size_t close_len  = t->comment_block_length[1];
+    const char*  it         = t->target + position + t->comment_block_length[0];
+    const char*  stop       = t->target + end;
+
+    while(it < stop && (it = memchr(it, close[0], stop - it))) {
+        if ((size_t)(stop - it) >= close_len && memcmp(it, close, close_len) == 0) 
+            return (it - t->target) + close_len;
+        it++;
+    }
+    return end;
+}
+
+// fills `splits` with chunk bounds (count + 1 of them), returns chunk count.
+// only openers are visited, memchr jumps over everything else
+size_t __tkn_find_splits(const Tokenizer* t, size_t* splits, size_t chunks) {
+    const size_t begin  = t->position;
+    const size_t end    = t->target_length;
+    const size_t step   = (end - begin) / chunks;
+    size_t next[3]      = { INVALID_INDEX, INVALID_INDEX, INVALID_INDEX };
+    size_t count        = 0;
+    size_t target       = begin + step;
+    size_t position     = begin;
+
+    splits[count++] = begin;
+
+    while(position < end && count < chunks) {
+        const size_t opener = __tkn_next_opener(t, next, position, end);
+
+        // new lines before the opener are safe to split at
+        while(target < opener && count < chunks) {
+            const size_t from = (target > position) ? target : position;
+            const char*  eol  = memchr(t->target + from, '\n', opener - from);
+            if (!eol) break;
+            splits[count++] = (eol - t->target) + 1;
+            target = splits[count - 1] + step;
+        }
+        if (opener >= end) break;
+
+        if (__tkn_starts_with_at(t, opener, t->comment_block[0], t->comment_block_length[0]))
+            position = __tkn_split_skip_block_comment(t, opener, end);
+        else if (__tkn_starts_with_at(t, opener, t->comment_line, t->comment_line_length)) {
+            const char* eol = memchr(t->target + opener, '\n', end - opener);
+            position = eol ? (size_t)(eol - t->target) : end;
+        } 
+        else if (t->target[opener] == t->string_quotes[0])
+            position = __tkn_split_skip_string(t, opener, end);
+        else 
+            position = opener + 1;
+    }
+
+    splits[count] = end;
+    return count;
+}
+
+#ifdef DT_TOKENIZER_THREADS
+
+typedef struct {
+    Tokenizer       lexer;  // private copy, lexes [position, target_length)
+    Token*          out;    // where tokens of this chunk go in the result
+    unsigned int*   remap;  // chunk's symbol id -> id in the shared table
+} TokenizerChunk;
+
+void* __tkn_chunk_lex(void* arg) {
+    TokenizerChunk* c = arg;
+    Token token = {0};
+    while( (token = Tokenizer_next_token(&c->lexer)).kind != TokenKind_EOF )
+        da_append(&c->lexer.tokens, token);
+    return NULL;
+}
+
+void* __tkn_chunk_merge(void* arg) {
+    TokenizerChunk* c = arg;
+    memcpy(c->out, c->lexer.tokens.items, c->lexer.tokens.count * sizeof(Token));
+    loop(i, c->lexer.tokens.count) {
+        if (c->out[i].flags & TokenFlag_symbol) 
+            c->out[i].aux = c->remap[c->out[i].aux];
+    }
+    free(c->lexer.tokens.items);
+    free(c->remap);
+    TokenSymbols_free(&c->lexer.symbols);
+    c->lexer.tokens = (Tokens) {0};
+    return NULL;
+}
+
+// run `fn` for every chunk (`size` bytes each), one thread each, 
+// chunk that failed to get a thread is done by the caller
+void dt_chunks_run(void* chunks, size_t size, size_t count, void* (*fn)(void*)) {
+    pthread_t threads[TOKENIZER_MAX_THREADS];
+    bool      started[TOKENIZER_MAX_THREADS];
+    char*     chunk = chunks;
+    assert(count <= TOKENIZER_MAX_THREADS);
+
+    loop(i, count) started[i] = pthread_create(&threads[i], NULL, fn, chunk + i * size) == 0;
+    loop(i, count) {
+        if (started[i]) pthread_join(threads[i], NULL);
+        else fn(chunk + i * size);
+    }
+}
 
-		else if (__is_decimal(current_symbol)) 
-			result = __tkn_get_number(*t,&step_size);
-	
-		else if (current_symbol == t->string_quotes[0]) {
-			result = __tkn_get_string_literall(*t,t->string_quotes,&step_size);
-		}
+// same result as Tokenizer_run, with input split between `threads` threads
+void Tokenizer_run_parallel(Tokenizer* t, size_t threads) {
+    assert(t && !t->stream && "Parallel mode needs whole input in memory");
+    const size_t length = t->target_length - t->position;
+    size_t splits[TOKENIZER_MAX_THREADS + 1];
 
-		else if (__is_eol(current_symbol)) {
-			result.kind = TokenKind_EOL;
-			t->position++;
-            t->row++;
-            t->col = 0;
-            if (t->skip_newline) goto retry;
-		}
+    if (threads > TOKENIZER_MAX_THREADS) threads = TOKENIZER_MAX_THREADS;
+    if (threads > length / TOKENIZER_PARALLEL_MIN_CHUNK) threads = length / TOKENIZER_PARALLEL_MIN_CHUNK;
 
-		else if (__is_space(current_symbol)) {
-			// skip until symbol is not space
-			// if it overflow it means we reached the end
-			for(size_t i = t->position; i <= t->target_length; i++)
-				if (!__is_space(t->target[i])) {
-					t->position += (i - t->position);
-					goto retry;
-				}	
-		}
-        else 
-            // TODO:
-            assert(0 && "Uknown to the tokenizer symbol");
-            //result = (Token) {0};
-        
+    const size_t count = threads > 1 ? __tkn_find_splits(t, splits, threads) : 1;
+    if (count < 2) {
+        const size_t saved = t->threads;
+        t->threads = 1;
+        Tokenizer_run(t);
+        t->threads = saved;
+        return;
+    }
 
-        t->col += step_size;
-		t->position += step_size;
+    TokenizerChunk* chunks = calloc(count, sizeof(TokenizerChunk));
+    assert(chunks && "Failed to allocate tokenizer chunks");
+
+    loop(i, count) {
+        TokenizerChunk* c = &chunks[i];
+        c->lexer                = *t;
+        c->lexer.tokens         = (Tokens) {0};
+        c->lexer.position       = splits[i];
+        c->lexer.target_length  = splits[i + 1];
+        c->lexer.lines          = NULL;
+        c->lexer.owns_lines     = false;
+        c->lexer.symbols        = (TokenSymbols) {0};
+    }
+    dt_chunks_run(chunks, sizeof(*chunks), count, __tkn_chunk_lex);
 
-        result.col = t->col;
-        result.row = t->row;
-		step_size = 0; // reset each time
-	}
+    size_t total = t->tokens.count;
+    loop(i, count) total += chunks[i].lexer.tokens.count;
 
-	// if we exausted a target string
-	// return EOF
-	else
-		result.kind = TokenKind_EOF;
+    if (total > t->tokens.capacity) {
+        t->tokens.items = realloc(t->tokens.items, total * sizeof(Token));
+        assert(t->tokens.items && "Failed to grow token list");
+        t->tokens.capacity = total;
+    }
+    loop(i, count) {
+        TokenizerChunk* c = &chunks[i];
+        c->out = t->tokens.items + t->tokens.count;
+        t->tokens.count += c->lexer.tokens.count;
+
+        // ids are private to chunks, move symbols into shared table in order
+        const TokenSymbols* s = &c->lexer.symbols;
+        c->remap = NULL;
+        if (s->count == 0) continue;
+        c->remap = malloc(s->count * sizeof(*c->remap));
+        assert(c->remap && "Failed to allocate symbol remap");
+        loop(j, s->count) 
+            c->remap[j] = TokenSymbols_intern(&t->symbols, 
+                    s->items[j].text, s->items[j].length, s->items[j].hash);
+    }
+    dt_chunks_run(chunks, sizeof(*chunks), count, __tkn_chunk_merge);
 
-	return result;
+    t->position = chunks[count - 1].lexer.position;
+    free(chunks);
 }
 
-// run tokenizer and save everything into growable stack
-void Tokenizer_run(Tokenizer* t) {
-	Token token = {0};
-	Tokens* s = &(t->tokens);
-	while( (token = Tokenizer_next_token(t)).kind != TokenKind_EOF ) {
-		da_append(s,token);
-	}
-}
+#endif // DT_TOKENIZER_THREADS
 
 #endif
 
@@ -584,8 +1572,16 @@ void Tokenizer_run(Tokenizer* t) {
 // PARSER
 //
 
-#define PARSER_TOKEN_BUFFER_SIZE    8
-#define PARSER_LOOK_AHEAD_COUNT     4
+// fewer tokens per thread are parsed serially
+#ifndef PARSER_PARALLEL_MIN_TOKENS
+#	define PARSER_PARALLEL_MIN_TOKENS (64*1024)
+#endif
+
+// dtp_reparse parses whole input again once nodes of replaced items
+// are more than this and more than half of the arena
+#ifndef PARSER_REPARSE_MIN_DEAD
+#	define PARSER_REPARSE_MIN_DEAD 4096
+#endif
 
 typedef enum {
     TI_NULL,
@@ -613,6 +1609,17 @@ typedef enum {
     TI_COMPARISON_LESS,
     TI_COMPARISON_GREATER_EQUAL,
     TI_COMPARISON_LESS_EQUAL,
+
+    // keywords, assigned to words at lex time
+    TI_KW_RETURN,
+    TI_KW_IF,
+    TI_KW_ELSE,
+    TI_KW_TRUE,
+    TI_KW_FALSE,
+    TI_KW_TYPE,
+    TI_KW_INCLUDE,
+
+    TI_COUNT,
 } TokenId;
 
 typedef enum {
@@ -657,6 +1664,9 @@ typedef enum {
     NKP_IS_EQALITY  = 8,
     NKP_IS_CMP_EQ   = 16,
     NKP_IS_CMP_GT   = 32,
+    NKP_HAS_NOT     = 64,
+    NKP_IS_LAZY     = 128, // block that is not parsed yet, see dtp_block_skip
+    NKP_IS_RESOLVED = 256, // function with locals mapped to slots, see dte_resolve_function
 } DtNodeKindProperties;
 
 const char* DT_NODE_KIND_STR[] = {
@@ -736,10 +1746,24 @@ typedef struct DtNode {
     DtNodeKind      kind;
     int             properties; // is term add or subtract?
     int             type;
+    unsigned int    body_token; // NKP_IS_LAZY: index of '{' in the whole input
     Token           identifier;
+    const char*     text; // of identifier, in source or stream pool
+
+    // set by dte_resolve_function. variables and identifiers: 1 + frame
+    // slot (0 is unresolved) and depth of block they were declared in,
+    // function declaration: slots its frame needs and arity in depth
+    unsigned short  slot;
+    unsigned short  depth;
+    // calls: function they called last, valid while it is in table
+    // callee_table at version callee_version, see dte_callee
+    const struct DtFunc*    callee;
+    const struct DtScope*   callee_table;
+    unsigned int            callee_version;
 
     struct DtNode*  next;
     struct DtNode*  children;
+    struct DtNode*  last_child; // tail of children, see dtp_node_append
 } DtNode;
 
 typedef struct {
@@ -751,6 +1775,7 @@ typedef struct {
 typedef struct {
     const char*     file_name;
     const char*     source;
+    TokenLines      lines; // line index of source, filled by the tokenizer
     bool            abort;
     bool            recorded_error;
     int             error_count;
@@ -759,21 +1784,44 @@ typedef struct {
     DtStrings       errors;
 } DtStatus;
 
+// top level node and tokens [begin, end) it was parsed from
+typedef struct {
+    DtNode*     node;
+    size_t      begin;
+    size_t      end;
+} DtParserItem;
+
+typedef struct {
+    DtParserItem*   items;
+    size_t          count;
+    size_t          capacity;
+} DtParserItems;
+
 typedef struct {
     DtStatus*   stat;
 
+    // whole input is lexed before parsing (see dtp_lex), parser
+    // moves over `tokens` with a cursor, so lookup before and after
+    // current token is just indexing. tokens[token_count] is EOF
     size_t      current;
-    size_t      requested_tokens,
-                parsed_tokens;
-    // we buffer PTBS(size) of tokens to be able 
-    // to lookup tokens before and after the current one
+    size_t      cursor;
     Tokenizer   lexer;
     Token       current_token;
-    Token       token_buffer
-                    [PARSER_TOKEN_BUFFER_SIZE];
+    const Token* tokens;
+    size_t      token_count;
+    size_t      token_base; // index of tokens[0] in the whole input
+
+    // dtp_parse splits top level between this many threads
+    size_t      threads;
+    // function bodies are skipped and parsed when they are needed,
+    // tokens have to be kept until then (see dtp_block_parse)
+    bool        lazy;
     
     DtNode*         root;
+    DtParserItems   items; // children of root, in order
     Arena           nodes;
+    size_t          node_count; // in arena, dead ones too
+    size_t          dead_nodes; // of items replaced by dtp_reparse
 } DtParser;
 
 // since i use my generic tokenizer here,
@@ -781,9 +1829,9 @@ typedef struct {
 // with specific to it parameters.
 Tokenizer DtTokenizer_init(const char* text, size_t len) {
     Tokenizer lexer = {0};
-    static char scratch_buffer[512];
 
-    static TokenTableEntry token_table[] = {
+    // shared by all tokenizers, never written to
+    static const TokenTableEntry token_table[] = {
         { "==",  TI_COMPARISON_EQUAL},
         { "!=",  TI_COMPARISON_NOT_EQUAL},
         { ">=",  TI_COMPARISON_GREATER_EQUAL},
@@ -810,17 +1858,38 @@ Tokenizer DtTokenizer_init(const char* text, size_t len) {
         { "<",   TI_COMPARISON_LESS},
     };
 
-	Tokenizer_init(&lexer,
+    static const TokenTableEntry keyword_table[] = {
+        { "return",     TI_KW_RETURN },
+        { "if",         TI_KW_IF },
+        { "else",       TI_KW_ELSE },
+        { "true",       TI_KW_TRUE },
+        { "false",      TI_KW_FALSE },
+        { "type",       TI_KW_TYPE },
+        { "include",    TI_KW_INCLUDE },
+    };
+
+	const bool ok = Tokenizer_init(&lexer,
 			token_table,
 			DT_ARRLEN(token_table),
+            keyword_table,
+            DT_ARRLEN(keyword_table),
 			text,
 			len,
-			scratch_buffer,
 			(symbol_t[2]) { '"', '"' },
             (const char* [2]) { "/*", "*/" },
+            "//",
             true // TODO: check new lines places
 	);
-    lexer.row = 1;
+    assert(ok && "Failed to find perfect hash for token table, increase TOKENIZER_HASH_SIZE");
+    (void) ok;
+    lexer.first_row = 1;
+    return lexer;
+}
+
+// same as DtTokenizer_init, but input is pulled through `read` in chunks
+Tokenizer DtTokenizer_init_stream(TokenizerStream* stream, TokenizerReadFn read, void* user) {
+    Tokenizer lexer = DtTokenizer_init(NULL, 0);
+    Tokenizer_stream(&lexer, stream, read, user);
     return lexer;
 }
 
@@ -830,7 +1899,6 @@ Tokenizer DtTokenizer_init(const char* text, size_t len) {
 
 // TODO: make this funtion work correctly on any suppoerted os (win/linux/android/mac/etc)
 char* dt_load_file(const char* path) {
-    static char empty_string[64];
     size_t len = 0;
     FILE* file = 0;
     file = fopen(path, "r+");
@@ -843,7 +1911,7 @@ char* dt_load_file(const char* path) {
 
     if (len == 0) {
         fclose(file);
-        return empty_string;
+        return calloc(1, 1);
     }
 
     char* content = calloc(len + 1, 1);
@@ -853,63 +1921,85 @@ char* dt_load_file(const char* path) {
     return content;
 }
 
+// readers for DtTokenizer_init_stream
+
+// user: FILE*
+size_t dt_read_file(void* user, char* buffer, size_t capacity) {
+    return fread(buffer, 1, capacity, (FILE*) user);
+}
+
+#ifndef _WIN32
+#include <unistd.h>
+
+// user: int* (file descriptor, pipe, socket)
+size_t dt_read_fd(void* user, char* buffer, size_t capacity) {
+    ssize_t n = 0;
+    do n = read(*(int*) user, buffer, capacity); 
+    while(n < 0 && errno == EINTR);
+    return (n > 0) ? (size_t) n : 0;
+}
+#endif
+
 //
 // PARSER / LEXER / LEX / PAR
 //
 void dtp_print_token_buffer(DtParser p) {
     printf("current: %lu\t", p.current);
-    printf("buffer: [ ");
-    loop(i, PARSER_TOKEN_BUFFER_SIZE) 
-        printf("%i ", p.token_buffer[i].kind);
+    printf("tokens: [ ");
+    for(size_t i = p.current; i < p.current + 8 && i <= p.token_count; i++) 
+        printf("%i ", p.tokens[i].kind);
     printf("] ");
  
 }
 
-void dtp_load_tokens_buffer(DtParser* p) {
+// lex whole input into lexer.tokens and end it with EOF,
+// that every index past the end is mapped to. Streamed input is
+// read to the end here too, its tokens are all kept
+void dtp_lex(DtParser* p) {
+    if (p->tokens) return;
     Tokenizer* lexer = &(p->lexer);
-    // Buffer tokens in batches of set size
-    // so that its easy to check previous 
-    if (p->parsed_tokens == 0) {
-        loop(i, PARSER_TOKEN_BUFFER_SIZE) {
-            p->token_buffer[p->parsed_tokens++] = 
-                Tokenizer_next_token(lexer);
-        }
-    } else if (p->requested_tokens + PARSER_LOOK_AHEAD_COUNT > p->parsed_tokens) {
-        loop(i,PARSER_LOOK_AHEAD_COUNT)
-            p->token_buffer[(p->parsed_tokens++) % PARSER_TOKEN_BUFFER_SIZE] = 
-                Tokenizer_next_token(lexer);
-    } 
+    Tokenizer_run(lexer);
+    Token eof = Tokenizer_next_token(lexer);
+    assert(eof.kind == TokenKind_EOF);
+    da_append(&lexer->tokens, eof);
+
+    p->tokens      = lexer->tokens.items;
+    p->token_count = lexer->tokens.count - 1;
+}
+
+// out of range index (before start too, it wraps) gives EOF
+static inline Token dtp_token_at(const DtParser* p, size_t index) {
+    return p->tokens[index < p->token_count ? index : p->token_count];
 }
 
 Token dtp_step(DtParser* p) {
-    dtp_load_tokens_buffer(p);
-    p->current = p->requested_tokens;
-    Token tk = p->token_buffer[(p->requested_tokens++) % PARSER_TOKEN_BUFFER_SIZE];
-    p->current_token = tk;
-    return tk;
+    p->current = p->cursor++;
+    p->current_token = dtp_token_at(p, p->current);
+    return p->current_token;
 }
 
 Token dtp_back(DtParser* p) {
-    if (p->parsed_tokens == 0) return p->token_buffer[p->parsed_tokens-1];
-    Token tk = p->token_buffer[(p->requested_tokens--) % PARSER_TOKEN_BUFFER_SIZE];
-    p->current_token = tk;
-    return tk;
+    if (p->cursor == 0) return p->current_token;
+    p->cursor--;
+    p->current = p->cursor - 1;
+    p->current_token = dtp_token_at(p, p->current);
+    return p->current_token;
 }
 
 Token dtp_before(DtParser* p) {
-    return p->token_buffer[(p->current-1) % PARSER_TOKEN_BUFFER_SIZE];
+    return dtp_token_at(p, p->current - 1);
 }
 
 Token dtp_ahead(DtParser* p) {
-    return p->token_buffer[(p->current+1) % PARSER_TOKEN_BUFFER_SIZE];
+    return dtp_token_at(p, p->current + 1);
 }
 
 Token dtp_aheadc(DtParser* p, int step) {
-    return p->token_buffer[(p->current+step) % PARSER_TOKEN_BUFFER_SIZE];
+    return dtp_token_at(p, p->current + step);
 }
 
 Token dtp_beforec(DtParser* p, int step) {
-    return p->token_buffer[(p->current-step) % PARSER_TOKEN_BUFFER_SIZE];
+    return dtp_token_at(p, p->current - step);
 }
 
 bool dtp_have_tokens(DtParser* p) {
@@ -931,21 +2021,26 @@ bool dtp_match_kind(Token t, TokenKind kind) {
 //#define DT_TOKEN_DEBUG
 
 #ifdef DT_TOKEN_DEBUG
-    #define token_dump_str(T) printf("T: %.*s\n", (int) T.data.as_word.length, T.data.as_word.data)
-    #define token_dump_sym(T) printf("T: %c\n", T.data.as_symbol)
+    #define token_dump_str(T) printf("T: %u bytes at %u\n", T.length, T.offset)
+    #define token_dump_sym(T) printf("T: %c\n", Token_symbol(T))
 #else 
     #define token_dump_str(T) /* nothing */
     #define token_dump_sym(T) /* nothing */
 #endif
 
-bool dtp_match_str(Token t, const char* text) {
+bool dtp_match_str(DtParser* p, Token t, const char* text) {
     token_dump_str(t);
     return 
         dtp_valid_token(t) &&
-        t.kind == TokenKind_word && 
-        t.data.as_word.data &&
-        strlen(text) == t.data.as_word.length &&
-        strncmp(t.data.as_word.data, text, t.data.as_word.length) == 0;
+        Token_compare_cstr(&p->lexer, t, text);
+}
+
+// keywords and operators are identified by the tokenizer,
+// so matching them is just an integer compare
+bool dtp_match_id(Token t, tokenid_t id) {
+    return 
+        dtp_valid_token(t) &&
+        t.id == id;
 }
 
 bool dtp_match_sym(Token t,char sym) {
@@ -953,21 +2048,27 @@ bool dtp_match_sym(Token t,char sym) {
     return 
         dtp_valid_token(t) &&
         t.kind == TokenKind_symbol && 
-        t.data.as_symbol == sym;
+        Token_symbol(t) == sym;
 }
 
 bool is_space(char c) {
     return c == '\t' || c == ' ';
 }
 
-Slice dtp_get_line(const char* source, int r) {
+// rows start from 1, same as in DtTokenizer_init
+void dtp_location(const DtStatus* stat, size_t offset, size_t* row, size_t* col) {
+    const size_t line = TokenLines_find(&stat->lines, offset);
+    *row = line + 1;
+    *col = offset - TokenLines_start(&stat->lines, line) + 1;
+}
+
+Slice dtp_get_line(const DtStatus* stat, int r) {
     const char* line_end = 0;
-    int newl_count = 1;
+    const char* source   = stat->source;
 
-    while(newl_count != r && *source != 0) {
-        if (*source == '\n') newl_count++;
-        source++;
-    }
+    if (!source || r < 1 || (size_t)(r - 1) > stat->lines.count) 
+        return (Slice) {0};
+    source += TokenLines_start(&stat->lines, r - 1);
  
     // trim left
     while(is_space(*source))
@@ -987,7 +2088,7 @@ Slice dtp_get_line(const char* source, int r) {
 void dtp_error_message(DtStatus* stat, const char* message, int r, int c) {
     stat->abort = true;
     StringBuilder* sb = &(stat->error_builder);
-    //Slice line = dtp_get_line(stat->source, r);
+    //Slice line = dtp_get_line(stat, r);
     /*
     sb_append(sb, 
             "\n"
@@ -1018,7 +2119,9 @@ void dtp_error_message(DtStatus* stat, const char* message, int r, int c) {
 
 void dtp_error(DtParser* p, const char* message) {
     assert(0);
-    dtp_error_message(p->stat, message, p->lexer.row, p->lexer.col);
+    size_t row, col;
+    Tokenizer_location(&p->lexer, Tokenizer_offset(&p->lexer), &row, &col);
+    dtp_error_message(p->stat, message, row, col);
 }
 
 
@@ -1032,10 +2135,18 @@ void dtp_error_push(DtParser* p) {
 
 void dtp_error_token(DtParser *p, Token t, const char* message) {
     assert(0);
-    dtp_error_message(p->stat, message, t.row, t.col); //!dtp_valid_token(t));
+    size_t row, col;
+    Tokenizer_location(&p->lexer, t.offset, &row, &col);
+    dtp_error_message(p->stat, message, row, col); //!dtp_valid_token(t));
+}
+
+#define dtp_expect_str(P,T,S,E) if (!dtp_match_str(P, T, S)) {\
+    assert(0);\
+    dtp_error_token(P, T, E);\
+    return NULL;\
 }
 
-#define dtp_expect_str(P,T,S,E) if (!dtp_match_str(T, S)) {\
+#define dtp_expect_id(P,T,I,E) if (!dtp_match_id(T, I)) {\
     assert(0);\
     dtp_error_token(P, T, E);\
     return NULL;\
@@ -1090,24 +2201,26 @@ Slice dt_slice_from_cstr(char* cstr) {
     return s;
 }
 
-Slice dtp_slice_from_token(Token t) {
+Slice dtp_slice_from_token(DtParser* p, Token t) {
     assert(t.kind == TokenKind_word);
+    TknSlice text = Tokenizer_text(&p->lexer, t);
     Slice s = {
-        .data = t.data.as_word.data,
-        .length = t.data.as_word.length,
+        .data = text.data,
+        .length = text.length,
     };
     return s;
 }
 
-bool tkn_strncmp(Token t, const char* cmp, size_t length) {
+bool tkn_strncmp(const Tokenizer* lexer, Token t, const char* cmp, size_t length) {
+    TknSlice text = Tokenizer_text(lexer, t);
     return 
         t.kind == TokenKind_word && 
-        length == t.data.as_word.length && 
-        strncmp(t.data.as_word.data, cmp, t.data.as_word.length) == 0;
+        length == text.length && 
+        strncmp(text.data, cmp, text.length) == 0;
 }
 
-bool tkn_strcmp(Token t, const char* cmp) {
-    return tkn_strncmp(t, cmp, strlen(cmp));
+bool tkn_strcmp(const Tokenizer* lexer, Token t, const char* cmp) {
+    return tkn_strncmp(lexer, t, cmp, strlen(cmp));
 }
 
 
@@ -1115,10 +2228,43 @@ bool tkn_strcmp(Token t, const char* cmp) {
 DtNode* dtp_node_new(DtParser* p) {
     DtNode* node = arena_alloc(&(p->nodes), sizeof(DtNode));
     node->source_location = p->current_token; 
+    p->node_count++;
     return node;
 }
 
+// text is resolved once here, so that tree can be used without lexer.
+// words and strings are in source, token table or pool, all stay valid
+void dtp_node_set_identifier(DtParser* p, DtNode* node, Token t) {
+    const bool has_text = t.kind == TokenKind_word || t.kind == TokenKind_literall_string;
+    node->identifier = t;
+    node->text       = has_text ? Tokenizer_text(&p->lexer, t).data : NULL;
+}
+
+Slice dtp_node_text(const DtNode* node) {
+    Slice s = {
+        .data   = node->text,
+        .length = node->text ? node->identifier.length : 0,
+    };
+    return s;
+}
+
+// 1 + symbol id of identifier, 0 if it was not interned
+unsigned int dtp_node_symbol(const DtNode* node) {
+    return (node->identifier.flags & TokenFlag_symbol) ? node->identifier.aux + 1 : 0;
+}
 
+bool dtp_node_compare_cstr(const DtNode* node, const char* cstr) {
+    const size_t len = strlen(cstr);
+    return 
+        (node->identifier.kind == TokenKind_word || 
+         node->identifier.kind == TokenKind_literall_string) &&
+        node->text &&
+        node->identifier.length == len &&
+        strncmp(node->text, cstr, len) == 0;
+}
+
+
+// walks the list, build children with dtp_node_append instead
 DtNode* dtp_node_push(DtNode* begin, DtNode* item) {
     if (!begin)
         begin = item;
@@ -1133,15 +2279,19 @@ DtNode* dtp_node_push(DtNode* begin, DtNode* item) {
     return begin;
 }
 
+// `children` may be a list, only it is walked to find the new tail,
+// so building a list of N children is O(N)
 DtNode* dtp_node_append(DtNode* father, DtNode* children) {
-    if(!father->children) {
+    if (!children) return father;
+    if(!father->children)
         father->children = children;
-    } else {
-        DtNode* tail = father->children;
-        while(tail->next)
-            tail = tail->next;
-        tail->next = children;
-    }
+    else
+        father->last_child->next = children;
+
+    DtNode* tail = children;
+    while(tail->next)
+        tail = tail->next;
+    father->last_child = tail;
     return father;
 }
 
@@ -1175,17 +2325,17 @@ parse_branch_again:
     
     switch (branch_type) {
         case BRANCH_IF: 
-            dtp_expect_str(p, keyword, "if",  "Expected if");
+            dtp_expect_id(p, keyword, TI_KW_IF,  "Expected if");
             break;
 
         case BRANCH_ELIF: 
-            dtp_expect_str(p, keyword, "else",  "Expected else");
+            dtp_expect_id(p, keyword, TI_KW_ELSE,  "Expected else");
             keyword = dtp_step(p);
-            dtp_expect_str(p, keyword, "if",  "Expected else");
+            dtp_expect_id(p, keyword, TI_KW_IF,  "Expected else");
             break;
 
         case BRANCH_ELSE: 
-            dtp_expect_str(p, keyword, "else",  "Expected else");
+            dtp_expect_id(p, keyword, TI_KW_ELSE,  "Expected else");
             break;
     }
     DtNode* branch = dtp_node_new(p);
@@ -1199,8 +2349,8 @@ parse_branch_again:
 
     //BREAKPOINT();
     
-    if (dtp_match_str(dtp_ahead(p), "else")) {
-        if (dtp_match_str(dtp_aheadc(p,2), "if")) 
+    if (dtp_match_id(dtp_ahead(p), TI_KW_ELSE)) {
+        if (dtp_match_id(dtp_aheadc(p,2), TI_KW_IF)) 
             branch_type = BRANCH_ELIF;
         else 
             branch_type = BRANCH_ELSE;
@@ -1222,7 +2372,7 @@ DtNode* dtp_statement(DtParser* p, int depth) {
     DtNode* self = 0;
     
     // return
-    if (dtp_match_str(dtp_ahead(p), "return")) {
+    if (dtp_match_id(dtp_ahead(p), TI_KW_RETURN)) {
         self = dtp_node_new(p);
         self->kind = NK_RETURN;
         
@@ -1235,7 +2385,7 @@ DtNode* dtp_statement(DtParser* p, int depth) {
     } 
 
     // if
-    else if(dtp_match_str(dtp_ahead(p),"if")) {
+    else if(dtp_match_id(dtp_ahead(p), TI_KW_IF)) {
         self = dtp_if_statement(p, depth + 1);
         return self;
     }
@@ -1281,7 +2431,7 @@ DtNode* dtp_function_return_type(DtParser* p, int depth) {
     Token type = {0};
 
     dtp_expect_kind(p,(type = dtp_step(p)),TokenKind_word, "Expected return type");
-    self->identifier = type;
+    dtp_node_set_identifier(p, self, type);
     
     return self;
 }
@@ -1310,6 +2460,61 @@ DtNode* dtp_block(DtParser* p, int depth, bool step_at_last) {
 }
 
 
+// steps over block by matching brackets, position of it is kept
+// and dtp_block_parse fills node in when body is needed
+DtNode* dtp_block_skip(DtParser* p) {
+    DtNode* self = dtp_node_new(p);
+    self->kind       = NK_BLOCK;
+    self->properties = NKP_IS_LAZY;
+
+    dtp_expect_sym(p, dtp_step(p), '{', "Expected '{' ");
+    self->body_token = p->token_base + p->current;
+
+    long   depth = 1;
+    size_t i     = p->cursor;
+    for(; i < p->token_count && depth; i++) {
+        if (p->tokens[i].kind != TokenKind_symbol) continue;
+        switch(Token_symbol(p->tokens[i])) {
+            case '{': depth++; break;
+            case '}': depth--; break;
+        }
+    }
+    p->cursor = i - 1;
+    dtp_expect_sym(p, dtp_step(p), '}', "Expected '}' ");
+    return self;
+}
+
+// parse body that was skipped, `block` becomes the same as if dtp_block
+// parsed it right away. Parser has to be the one that skipped it
+DtNode* dtp_block_parse(DtParser* p, DtNode* block) {
+    if (!(block->properties & NKP_IS_LAZY)) return block;
+    assert(block->kind == NK_BLOCK);
+    assert(block->body_token >= p->token_base && 
+           block->body_token - p->token_base < p->token_count && "Tokens of lazy block are gone");
+
+    const size_t cursor  = p->cursor;
+    const size_t current = p->current;
+    const Token  token   = p->current_token;
+    const bool   lazy    = p->lazy;
+
+    p->lazy          = false;
+    p->cursor        = block->body_token - p->token_base;
+    p->current       = p->cursor - 1;
+    p->current_token = dtp_token_at(p, p->current);
+    DtNode* parsed   = dtp_block(p, 0, true);
+
+    block->children     = parsed->children;
+    block->last_child   = parsed->last_child;
+    block->properties  &= ~NKP_IS_LAZY;
+
+    p->cursor        = cursor;
+    p->current       = current;
+    p->current_token = token;
+    p->lazy          = lazy;
+    return block;
+}
+
+
 DtNode* dtp_symbol_declaration(DtParser* p, int depth) {
     IGNORE_VALUE depth;
 
@@ -1326,9 +2531,9 @@ DtNode* dtp_symbol_declaration(DtParser* p, int depth) {
     self = dtp_node_new(p);
     DtNode* nt = dtp_node_new(p);
     nt->kind = NK_TYPE;
-    nt->identifier = type;
+    dtp_node_set_identifier(p, nt, type);
     self->kind = NK_SYMBOL_DECL;
-    self->identifier = var;
+    dtp_node_set_identifier(p, self, var);
     dtp_node_append(self, nt);
 
     // TODO: set identifer 
@@ -1348,7 +2553,7 @@ DtNode* dtp_function_declaration(DtParser* p, int depth) {
     args->kind = NK_FUNCTION_ARGS;
 
     dtp_expect_kind (p, p->current_token, TokenKind_word, "Expected word");
-    self->identifier = p->current_token;
+    dtp_node_set_identifier(p, self, p->current_token);
 
     dtp_expect_sym  (p, dtp_step(p), '(', "Expected '('");
 
@@ -1391,7 +2596,7 @@ DtNode* dtp_function_declaration(DtParser* p, int depth) {
         dtp_node_append(self, dtp_function_return_type(p, depth+1));
     }
 
-    DtNode* block = dtp_block(p, depth+1, true);
+    DtNode* block = p->lazy ? dtp_block_skip(p) : dtp_block(p, depth+1, true);
     //if (!block) {
         //dtp_error_token_trace(p, p->current_token, "Failed to parse function body");
        // return NULL;
@@ -1405,7 +2610,7 @@ DtNode* dtp_function_call(DtParser* p, int depth) {
     DtNode* self = dtp_node_new(p);
     //DtNode* node = {0};
     self->kind = NK_FUNCTION_CALL;
-    self->identifier = p->current_token;
+    dtp_node_set_identifier(p, self, p->current_token);
     self->source_location = p->current_token;
     
     dtp_expect_kind (p,p->current_token, TokenKind_word, "Expected word");
@@ -1514,14 +2719,14 @@ bool dtp_is_mul(Token t) {
 
 bool dtp_is_cmp(Token t) {
     return 
-        dtp_match_sym(t, '>') || dtp_match_sym(t, '<') || 
-        dtp_match_str(t, ">=") || dtp_match_str(t, "<=")
+        dtp_match_id(t, TI_COMPARISON_GREATER) || dtp_match_id(t, TI_COMPARISON_LESS) || 
+        dtp_match_id(t, TI_COMPARISON_GREATER_EQUAL) || dtp_match_id(t, TI_COMPARISON_LESS_EQUAL)
     ;
 }
 
 bool dtp_is_eql(Token t) {
     return 
-        dtp_match_str(t, "==") || dtp_match_str(t, "!=")
+        dtp_match_id(t, TI_COMPARISON_EQUAL) || dtp_match_id(t, TI_COMPARISON_NOT_EQUAL)
     ;
 }
 
@@ -1538,210 +2743,90 @@ DtNode* dtp_branch(DtParser* p, DtNode* l, DtNode* r, DtNodeKind kind) {
     return self;
 }
 
-DtNode* dtp_comparison  (DtParser*, int);
-DtNode* dtp_equality    (DtParser*, int);
-DtNode* dtp_factor      (DtParser*, int);
-DtNode* dtp_term        (DtParser*, int);
 DtNode* dtp_primary     (DtParser*, int);
-DtNode* dtp_unary       (DtParser*, int);
-
-
-DtNode* dtp_equality(DtParser* p, int depth) {
-    enum {
-        OP_CMP_ONCE,
-        OP_CMP_MANY,
-    };
-
-    bool is_equality[2] = {0};
-    DtNode *l = 0, *r = 0, *rr = 0;
-    l = dtp_comparison(p, depth + 1);
-
-    if (dtp_is_eql(dtp_ahead(p))) {
-        
-        if (dtp_match_str(dtp_step(p),"==")) 
-            is_equality[OP_CMP_ONCE] = true;
-
-        r = dtp_factor(p, depth + 1);
-        if (dtp_is_eql(dtp_ahead(p))) {
-   
-            if (dtp_match_str(dtp_step(p),"==")) 
-                is_equality[OP_CMP_MANY] = true;
-            
-            rr = dtp_term(p, depth + 1);
-            r = dtp_branch(p, r, rr, NK_EQALITY);
-            
-            r->properties |= NKP_IS_EQALITY * is_equality[OP_CMP_MANY];
-        }
-        DtNode* result = dtp_branch(p, l, r, NK_EQALITY);
-        result->properties |= NKP_IS_EQALITY * is_equality[OP_CMP_ONCE];
-        return result;
-    }
-    return l;
-}
 
-/*
-DtNode* dtp_equality(DtParser* p, int depth) {
-    DtNode *l = 0, *r = 0;
-    // *rr = 0;
-    l = dtp_comparison(p, depth + 1);
+//
+// EXPRESSIONS
+//
+// Pratt parser: binary operators are looked up by token id, operand
+// is parsed first and then operators are folded in while they bind at
+// least as tight as the caller asked for. All operators are left
+// associative. Node kinds and properties are the same the evaluator
+// expects (NK_TERM with NKP_IS_ADD and so on), no nodes are created
+// except operators and values themselves.
+//
 
-    if (dtp_is_eql(dtp_ahead(p))) {
-        
-        dtp_step(p); // skip cmp
-        r = dtp_comparison(p, depth + 1);
+typedef struct {
+    unsigned char   precedence; // 0 if token is not a binary operator
+    unsigned char   kind;       // DtNodeKind
+    unsigned short  properties; // NKP_*
+} DtOperator;
+
+const DtOperator DTP_BINARY_OPERATORS[TI_COUNT] = {
+    [TI_COMPARISON_EQUAL]           = { 1, NK_EQALITY,      NKP_IS_EQALITY },
+    [TI_COMPARISON_NOT_EQUAL]       = { 1, NK_EQALITY,      0 },
+    [TI_COMPARISON_GREATER]         = { 2, NK_COMPARISON,   NKP_IS_CMP_GT },
+    [TI_COMPARISON_LESS]            = { 2, NK_COMPARISON,   0 },
+    [TI_COMPARISON_GREATER_EQUAL]   = { 2, NK_COMPARISON,   NKP_IS_CMP_GT | NKP_IS_CMP_EQ },
+    [TI_COMPARISON_LESS_EQUAL]      = { 2, NK_COMPARISON,   NKP_IS_CMP_EQ },
+    [TI_PLUS]                       = { 3, NK_TERM,         NKP_IS_ADD },
+    [TI_MINUS]                      = { 3, NK_TERM,         0 },
+    [TI_MUL]                        = { 4, NK_FACTOR,       NKP_IS_MUL },
+    [TI_DIV]                        = { 4, NK_FACTOR,       0 },
+};
 
-        DtNode* result = dtp_branch(p, l, r, NK_EQALITY);
-        return result;
-    }
-    return l;
+static inline const DtOperator* dtp_binary_operator(Token t) {
+    if (!dtp_valid_token(t) || t.id >= TI_COUNT) return NULL;
+    const DtOperator* op = &DTP_BINARY_OPERATORS[t.id];
+    return op->precedence ? op : NULL;
 }
-*/
 
-DtNode* dtp_comparison(DtParser* p, int depth) {
-    enum {
-        OP_CMP_ONCE,
-        OP_CMP_MANY,
-    };
-    bool is_cmp_eq  [2] = {0};
-    bool is_cmp_gt  [2] = {0};
-
-    DtNode *l = 0, *r = 0, *rr = 0;
-    l = dtp_term(p, depth + 1);
-
-    if (dtp_is_cmp(dtp_ahead(p))) {
-        
-        Token cmp = dtp_step(p);
-        if (dtp_match_sym(cmp,'>')) 
-            is_cmp_gt[OP_CMP_ONCE] = true;
-        else if (dtp_match_sym(cmp,'<')) 
-            is_cmp_gt[OP_CMP_ONCE] = false;
-        else if (dtp_match_str(cmp, ">=")) {
-            is_cmp_eq[OP_CMP_ONCE] = true;
-            is_cmp_gt[OP_CMP_ONCE] = true;
-        } else if (dtp_match_str(cmp, "<=")) {
-            is_cmp_eq[OP_CMP_ONCE] = true;
-            is_cmp_gt[OP_CMP_ONCE] = false;
-        } else 
-            assert(0);
-
-        r = dtp_term(p, depth + 1);
-
-        if (dtp_is_cmp(dtp_ahead(p))) {
-   
-            Token cmp = dtp_step(p);
-            if (dtp_match_sym(cmp,'>')) 
-                is_cmp_gt[OP_CMP_MANY] = true;
-            else if (dtp_match_sym(cmp,'<')) 
-                is_cmp_gt[OP_CMP_MANY] = false;
-            else if (dtp_match_str(cmp, ">=")) {
-                is_cmp_eq[OP_CMP_MANY] = true;
-                is_cmp_gt[OP_CMP_MANY] = true;
-            } else if (dtp_match_str(cmp, "<=")) {
-                is_cmp_eq[OP_CMP_MANY] = true;
-                is_cmp_gt[OP_CMP_MANY] = false;
-            } else 
-                assert(0);
-            
-            rr = dtp_comparison(p, depth + 1);
-            r = dtp_branch(p, r, rr, NK_COMPARISON);
-            
-            r->properties |= NKP_IS_CMP_EQ  * is_cmp_eq[OP_CMP_MANY];
-            r->properties |= NKP_IS_CMP_GT  * is_cmp_gt[OP_CMP_MANY];
+// prefix `-` and `!`, kept as properties of the operand. they are
+// applied as negate first, then not, so `-!x` needs a node to hold it
+DtNode* dtp_unary(DtParser* p, int depth) {
+    Token   ops[32];
+    size_t  count = 0;
+    while(dtp_is_unary(dtp_ahead(p))) {
+        if (count == DT_ARRLEN(ops)) {
+            dtp_error_token(p, dtp_ahead(p), "Too many unary operators in a row");
+            return NULL;
         }
-
-        DtNode* result = dtp_branch(p, l, r, NK_COMPARISON);
-        result->properties |= NKP_IS_CMP_EQ  * is_cmp_eq[OP_CMP_ONCE];
-        result->properties |= NKP_IS_CMP_GT  * is_cmp_gt[OP_CMP_ONCE];
-        return result;
+        ops[count++] = dtp_step(p);
     }
 
-    return l;
-}
-
-DtNode* dtp_term(DtParser* p, int depth) {
-    enum {
-        OP_ADD_ONCE,
-        OP_ADD_MANY,
-    };
-
-    bool is_plus[2] = {0};
-    DtNode *l = 0, *r = 0, *rr = 0;
-    l = dtp_factor(p, depth + 1);
+    DtNode* self = dtp_primary(p, depth + 1);
+    if (!self) return NULL;
 
-    if (dtp_is_add(dtp_ahead(p))) {
-        
-        if (dtp_match_sym(dtp_step(p),'+')) 
-            is_plus[OP_ADD_ONCE] = true;
-        r = dtp_factor(p, depth + 1);
-
-        if (dtp_is_add(dtp_ahead(p))) {
-   
-            if (dtp_match_sym(dtp_step(p),'+')) 
-                is_plus[OP_ADD_MANY] = true;
-            
-            rr = dtp_term(p, depth + 1);
-            r = dtp_branch(p, r, rr, NK_TERM);
-            
-            r->properties |= NKP_IS_ADD * is_plus[OP_ADD_MANY];
+    while(count--) {
+        const bool is_not = dtp_match_sym(ops[count], '!');
+        if (!is_not && (self->properties & NKP_HAS_NOT)) {
+            DtNode* wrap = dtp_node_new(p);
+            wrap->kind = NK_EXPRESSION;
+            wrap->source_location = ops[count];
+            self = dtp_node_append(wrap, self);
         }
-        DtNode* result = dtp_branch(p, l, r, NK_TERM);
-        result->properties |= NKP_IS_ADD * is_plus[OP_ADD_ONCE];
-        return result;
+        self->properties ^= is_not ? NKP_HAS_NOT : NKP_HAS_UNARY;
     }
-    return l;
+    return self;
 }
 
+// operand followed by operators of precedence `min_precedence` and up
+DtNode* dtp_binary(DtParser* p, int depth, int min_precedence) {
+    DtNode* l = dtp_unary(p, depth + 1);
+    const DtOperator* op;
 
-DtNode* dtp_factor(DtParser* p, int depth) {
-    enum {
-        OP_MUL_ONCE,
-        OP_MUL_MANY,
-    };
-
-    bool is_plus[2] = {0};
-    DtNode *l = 0, *r = 0, *rr = 0;
-    //l = dtp_primary(p, depth + 1);
-    l = dtp_unary(p, depth + 1);
-
-    if (dtp_is_mul(dtp_ahead(p))) {
-        
-        if (dtp_match_sym(dtp_step(p),'*')) 
-            is_plus[OP_MUL_ONCE] = true;
-        //r = dtp_primary(p, depth + 1);
-        r = dtp_unary(p, depth + 1);
-
-        if (dtp_is_mul(dtp_ahead(p))) {
-        
-            if (dtp_match_sym(dtp_step(p),'*')) 
-                is_plus[OP_MUL_MANY] = true;
-         
-            rr = dtp_factor(p, depth + 1);
-            r = dtp_branch(p, r, rr, NK_FACTOR);
-
-            r->properties |= NKP_IS_MUL * is_plus[OP_MUL_MANY];
-        }
+    while(l && (op = dtp_binary_operator(dtp_ahead(p))) && op->precedence >= min_precedence) {
+        const Token op_token = dtp_step(p);
+        DtNode* r = dtp_binary(p, depth + 1, op->precedence + 1);
+        if (!r) return NULL;
 
-        DtNode* result = dtp_branch(p, l, r, NK_FACTOR);
-        result->properties |= NKP_IS_MUL * is_plus[OP_MUL_ONCE];
-        return result;
+        l = dtp_branch(p, l, r, op->kind);
+        l->properties |= op->properties;
+        l->source_location = op_token;
     }
-
     return l;
 }
 
-DtNode* dtp_unary(DtParser* p, int depth) {
-    DtNode* self = 0;
-    if (dtp_is_unary(dtp_ahead(p))) {
-        dtp_step(p); // skip unary
-        self = dtp_unary(p, depth + 1);
-        self->properties |= NKP_HAS_UNARY;
-    } else 
-        self = dtp_primary(p, depth + 1);
-    return self;
-}
-
-
-
 DtNode* dtp_value(DtParser* p, int depth) {
     DtNode* self = dtp_node_new(p);
     //Token*  current_token = &(p->current_token);
@@ -1751,31 +2836,31 @@ DtNode* dtp_value(DtParser* p, int depth) {
     switch((name = dtp_step(p)).kind) {
         case TokenKind_literall_integer: 
             self->kind       = NK_INTLIT;
-            self->identifier = name;
+            dtp_node_set_identifier(p, self, name);
             break;
 
         case TokenKind_literall_float: 
             self->kind         = NK_FLTLIT;
-            self->identifier   = name;
+            dtp_node_set_identifier(p, self, name);
             break;
 
         case TokenKind_literall_string:
             self->kind         = NK_STRLIT;
-            self->identifier   = name;
+            dtp_node_set_identifier(p, self, name);
             break;
 
         case TokenKind_word: 
             if ( 
-                (match_true = (dtp_match_str(name, "true"))) || 
-                dtp_match_str(name, "false")
+                (match_true = (dtp_match_id(name, TI_KW_TRUE))) || 
+                dtp_match_id(name, TI_KW_FALSE)
             ){
                 self->kind = NK_BOOLIT;
-                self->identifier = name;
+                dtp_node_set_identifier(p, self, name);
                 break; 
             }
 
             self->kind = NK_IDENTIFIER;
-            self->identifier = name; 
+            dtp_node_set_identifier(p, self, name); 
             
             if (dtp_match_sym(dtp_ahead(p), '(')) {
                 self->kind = NK_FUNCTION_CALL;
@@ -1797,7 +2882,7 @@ DtNode* dtp_primary(DtParser* p, int depth) {
     if (dtp_match_sym(dtp_ahead(p), '(')) {
         dtp_expect_sym(p, dtp_step(p), '(', "Expected '('");
         
-        self = dtp_equality(p, depth + 1);
+        self = dtp_binary(p, depth + 1, 1);
        
         // TODO: URGENT: might have no effect or be a break-point  
 #if 0
@@ -1813,23 +2898,14 @@ DtNode* dtp_primary(DtParser* p, int depth) {
     } else 
         // TODO: handle this edge case
         printf("edging at dtp_prime(DtParser*, int) with: %s", 
-                Token_temp_cstr(p->current_token)
+                Token_temp_cstr(&p->lexer, p->current_token)
                 );//assert(0 && "Failed to parse prime");
     return self;
 }
 
 
 DtNode* dtp_expression(DtParser* p, int depth) {
-    IGNORE_VALUE depth;
-    DtNode* self = dtp_node_new(p);
-    //DtNode* node = {0};
-
-    DtNode* node = dtp_equality(p, depth + 1);
-    //Token value = dtp_step(p);
-    //dtp_expect_kind(value, TokenKind_literall_integer, "TODO: add more the just integers for expression");
-    
-    self->kind = NK_EXPRESSION;
-    return dtp_node_append(self, node);
+    return dtp_binary(p, depth + 1, 1);
 }
 
 
@@ -1888,7 +2964,7 @@ DtNode* dtp_variable(DtParser* p, int depth) {
     }
     self->kind = NK_VARIABLE;
 
-    self->identifier = name;
+    dtp_node_set_identifier(p, self, name);
 
     return self;
 }
@@ -1937,15 +3013,24 @@ DtNode* dtp_rvalue(DtParser* p, int depth) {
     return self;
 }
 
-DtNode* dtp_parse(DtParser* p, int depth) {
-    DtNode* self = dtp_node_new(p);
+// line index goes to status, so errors and anything that maps
+// node locations back to source do not have to rescan the input
+void dtp_track_lines(DtParser* p) {
+    if (p->lexer.lines) return;
+    Tokenizer_track_lines(&p->lexer, &p->stat->lines);
+    // whole input is here already, index it in one go
+    if (!p->lexer.stream) __tkn_lines_update(&p->lexer);
+}
+
+// top level items up to the end of tokens go under `self`
+DtNode* dtp_parse_items(DtParser* p, DtNode* self, int depth) {
     //DtNode* node = {0};
     Token name = {0};
     (void) name;
 
-    self->kind = NK_ROOT;
     while(dtp_have_tokens(p)) {
-        //dtp_load_tokens_buffer(p);
+        const size_t  begin = p->cursor;
+        const DtNode* last  = self->last_child;
         Token t     = dtp_step(p);//dtp_aheadc(p, 0);
         Token nt    = dtp_ahead(p);
 
@@ -1953,9 +3038,9 @@ DtNode* dtp_parse(DtParser* p, int depth) {
         //printf("%i, %i\n", t.kind, nt.kind);
 
         // we creating a type
-        if(dtp_match_str(t, "type")) {
+        if(dtp_match_id(t, TI_KW_TYPE)) {
             dtp_error(p, "TODO: implement type keyword");
-        } else if (dtp_match_str(t, "include")) {
+        } else if (dtp_match_id(t, TI_KW_INCLUDE)) {
             dtp_error(p, "TODO: implement include keyword");
 
         }
@@ -1997,10 +3082,448 @@ DtNode* dtp_parse(DtParser* p, int depth) {
             //printf("failed with token %s\n", Token_temp_cstr(t));
             dtp_abort(p, "Unexpected high level statement");
         }
+
+        if (self->last_child != last) {
+            DtParserItem item = { self->last_child, begin, p->cursor };
+            da_append(&p->items, item);
+        }
     }
     return self;
 }
 
+#ifdef DT_TOKENIZER_THREADS
+
+//
+// PARALLEL PARSING
+//
+// Top level is cut right before function declarations, found by
+// matching brackets over the tokens: `name (` at depth 0 just after
+// a `}` that closed depth 1. Each piece is parsed by a copy of the
+// parser over its own tokens, into its own arena. Trees are linked
+// under root in source order and arenas are moved into parser's one.
+//
+
+typedef struct {
+    DtParser    parser;
+    DtStatus    stat;
+    DtNode*     root;
+    Token*      tokens; // piece of input with EOF at the end
+    int         depth;
+} DtParserChunk;
+
+// splits[0..count] are token indices, returns number of pieces
+size_t dtp_find_splits(const DtParser* p, size_t* splits, size_t wanted) {
+    const Token* t = p->tokens;
+    const size_t n = p->token_count;
+    size_t count   = 0;
+    long   depth   = 0;
+    splits[0] = p->cursor;
+
+    for(size_t i = p->cursor; i + 1 < n && count + 1 < wanted; i++) {
+        if (t[i].kind == TokenKind_symbol) {
+            switch(Token_symbol(t[i])) {
+                case '{': case '(': case '[': depth++; break;
+                case '}': case ')': case ']': depth--; break;
+            }
+            continue;
+        }
+        const size_t target = splits[0] + (n - splits[0]) * (count + 1) / wanted;
+        if (i < target || depth != 0 || i == 0) continue;
+        if (t[i].kind == TokenKind_word && dtp_match_sym(t[i + 1], '(') && dtp_match_sym(t[i - 1], '}'))
+            splits[++count] = i;
+    }
+    splits[++count] = n;
+    return count;
+}
+
+void* dtp_chunk_parse(void* arg) {
+    DtParserChunk* c = arg;
+    c->root = dtp_node_new(&c->parser);
+    c->root->kind = NK_ROOT;
+    c->root = dtp_parse_items(&c->parser, c->root, c->depth);
+    return NULL;
+}
+
+DtNode* dtp_parse_parallel(DtParser* p, DtNode* self, int depth) {
+    size_t splits[TOKENIZER_MAX_THREADS + 1];
+    size_t threads = p->threads;
+    if (threads > TOKENIZER_MAX_THREADS) threads = TOKENIZER_MAX_THREADS;
+    if (threads > p->token_count / PARSER_PARALLEL_MIN_TOKENS) threads = p->token_count / PARSER_PARALLEL_MIN_TOKENS;
+
+    const size_t count = threads > 1 ? dtp_find_splits(p, splits, threads) : 1;
+    if (count < 2) return dtp_parse_items(p, self, depth);
+
+    DtParserChunk* chunks = calloc(count, sizeof(DtParserChunk));
+    assert(chunks && "Failed to allocate parser chunks");
+
+    loop(i, count) {
+        DtParserChunk* c = &chunks[i];
+        const size_t length = splits[i + 1] - splits[i];
+        c->tokens = malloc((length + 1) * sizeof(Token));
+        assert(c->tokens && "Failed to allocate parser chunk");
+        memcpy(c->tokens, p->tokens + splits[i], length * sizeof(Token));
+        c->tokens[length] = p->tokens[p->token_count];
+
+        // status is shared only for reading, errors are collected after
+        c->stat                 = *p->stat;
+        c->stat.errors          = (DtStrings) {0};
+        c->stat.error_builder   = (StringBuilder) {0};
+        c->parser               = *p;
+        c->parser.stat          = &c->stat;
+        c->parser.nodes         = (Arena) {0};
+        c->parser.node_count    = 0;
+        c->parser.items         = (DtParserItems) {0};
+        c->parser.tokens        = c->tokens;
+        c->parser.token_count   = length;
+        c->parser.token_base    = p->token_base + splits[i];
+        c->parser.cursor        = 0;
+        c->parser.current       = 0;
+        c->parser.current_token = (Token) {0};
+        c->depth                = depth;
+    }
+    dt_chunks_run(chunks, sizeof(*chunks), count, dtp_chunk_parse);
+
+    DtNode* result = self;
+    loop(i, count) {
+        DtParserChunk* c = &chunks[i];
+        if (c->root) 
+            dtp_node_append(self, c->root->children);
+        else 
+            result = NULL;
+        arena_merge(&p->nodes, &c->parser.nodes);
+        p->node_count += c->parser.node_count;
+        loop(j, c->parser.items.count) {
+            DtParserItem item = c->parser.items.items[j];
+            item.begin += splits[i];
+            item.end   += splits[i];
+            da_append(&p->items, item);
+        }
+        free(c->parser.items.items);
+
+        DtStatus* s = p->stat;
+        s->abort            |= c->stat.abort;
+        s->recorded_error   |= c->stat.recorded_error;
+        s->error_count      += c->stat.error_count;
+        s->warning_count    += c->stat.warning_count;
+        loop(j, c->stat.errors.count) da_append(&s->errors, c->stat.errors.items[j]);
+        free(c->stat.errors.items);
+        free(c->tokens);
+    }
+    p->cursor = p->token_count;
+    p->current = p->token_count;
+    p->current_token = p->tokens[p->token_count];
+    free(chunks);
+    return result;
+}
+
+#endif // DT_TOKENIZER_THREADS
+
+DtNode* dtp_parse(DtParser* p, int depth) {
+    dtp_track_lines(p);
+    dtp_lex(p);
+    DtNode* self = dtp_node_new(p);
+    self->kind = NK_ROOT;
+    p->root    = self;
+#ifdef DT_TOKENIZER_THREADS
+    if (p->threads > 1 && p->token_count - p->cursor >= 2 * PARSER_PARALLEL_MIN_TOKENS)
+        return dtp_parse_parallel(p, self, depth);
+#endif
+    return dtp_parse_items(p, self, depth);
+}
+
+//
+// INCREMENTAL PARSING
+//
+// After an edit only top level items around it are lexed and parsed
+// again. Lexing starts at the first token of the item before the edit
+// (edit can extend its last token) and stops at the first token of an
+// old item that is past the edit, from there on input is the same, only
+// moved. Function declarations in between that did not change are found
+// by hash of their tokens and reused, the rest is parsed again. Nodes of
+// replaced items stay in the arena until there are too many of them,
+// then whole input is parsed again (see PARSER_REPARSE_MIN_DEAD).
+//
+
+typedef struct {
+    size_t      start;      // first changed byte
+    size_t      old_end;    // end of replaced bytes in old source
+    size_t      new_end;    // end of their replacement in new source
+} DtEdit;
+
+// same token, wherever it is. String text is compared, rest is in fields
+bool dtp_token_same(Token a, const char* a_source, Token b, const char* b_source) {
+    return 
+        a.kind == b.kind && a.id == b.id && a.flags == b.flags &&
+        a.length == b.length && a.aux == b.aux &&
+        (a.kind != TokenKind_literall_string || 
+         memcmp(a_source + a.offset, b_source + b.offset, a.length) == 0);
+}
+
+// hash of token span, that does not depend on where span is
+unsigned int dtp_tokens_hash(const Token* tokens, size_t count, const char* source) {
+    unsigned int h = 2166136261u;
+    loop(i, count) {
+        const Token t = tokens[i];
+        const unsigned int fields[] = { t.kind | t.flags << 8 | (unsigned int) t.id << 16, t.length, t.aux };
+        loop(j, 3) h = (h ^ fields[j]) * 16777619u;
+        if (t.kind == TokenKind_literall_string)
+            loop(j, t.length) h = (h ^ (unsigned char) source[t.offset + j]) * 16777619u;
+    }
+    return h;
+}
+
+// tokens in function declaration that starts at `name (`, 0 if it does not end before `end`
+size_t dtp_function_span(const Token* tokens, size_t name, size_t end) {
+    long depth = 0;
+    bool body  = false;
+    for(size_t i = name + 1; i < end; i++) {
+        if (tokens[i].kind != TokenKind_symbol) continue;
+        switch(Token_symbol(tokens[i])) {
+            case '{': body |= depth == 0; // fallthrough
+            case '(': case '[': depth++; break;
+            case '}': case ')': case ']': 
+                if (--depth == 0 && body) return i + 1 - name;
+                break;
+        }
+    }
+    return 0;
+}
+
+// move locations of subtree by `delta` bytes and `shift` tokens,
+// and take text from current input
+void dtp_node_rebase(const Tokenizer* t, DtNode* node, long long delta, long long shift) {
+    node->source_location.offset += delta;
+    node->identifier.offset      += delta;
+    if (node->text) node->text = Tokenizer_text(t, node->identifier).data;
+    if ((node->properties & NKP_IS_LAZY) && node->kind == NK_BLOCK) node->body_token += shift;
+    for(DtNode* it = node->children; it; it = it->next)
+        dtp_node_rebase(t, it, delta, shift);
+}
+
+// parse tokens [begin, end) as top level items, EOF is put at `end` meanwhile
+void dtp_parse_range(DtParser* p, DtNode* scratch, size_t begin, size_t end) {
+    if (begin == end) return;
+    Token* tokens = p->lexer.tokens.items;
+    const Token saved = tokens[end];
+    tokens[end] = (Token) { .kind = TokenKind_EOF, .offset = saved.offset };
+
+    p->token_count   = end;
+    p->cursor        = begin;
+    p->current       = begin;
+    p->current_token = (Token) {0};
+    scratch->children = scratch->last_child = NULL;
+    dtp_parse_items(p, scratch, 0);
+
+    tokens[end] = saved;
+}
+
+// nodes of `node` and everything under it
+size_t dtp_node_count(const DtNode* node) {
+    size_t count = 1;
+    for(const DtNode* child = node->children; child; child = child->next) 
+        count += dtp_node_count(child);
+    return count;
+}
+
+// arena is dropped and input is lexed and parsed from the start,
+// symbol ids stay as they were
+DtNode* dtp_parse_again(DtParser* p) {
+    Tokenizer* lexer = &p->lexer;
+    arena_reset(&p->nodes);
+    free(p->items.items);
+    free(lexer->tokens.items);
+    lexer->tokens    = (Tokens) {0};
+    lexer->position  = 0;
+    p->items         = (DtParserItems) {0};
+    p->node_count    = 0;
+    p->dead_nodes    = 0;
+    p->tokens        = NULL;
+    p->token_count   = 0;
+    p->cursor        = 0;
+    p->current       = 0;
+    p->current_token = (Token) {0};
+    return dtp_parse(p, 0);
+}
+
+// `source` replaces source that was parsed last, old one has to be valid
+// until this returns. Root stays the same node and it is returned, unless
+// input was parsed again as a whole, then every node is new
+DtNode* dtp_reparse(DtParser* p, const char* source, size_t length, DtEdit edit) {
+    Tokenizer* lexer = &p->lexer;
+    assert(p->root && p->tokens && "Input has to be parsed before it can be reparsed");
+    assert(!lexer->stream && "Incremental parsing needs whole input in memory");
+    assert(edit.start <= edit.old_end && edit.old_end <= lexer->target_length && 
+           edit.start <= edit.new_end && edit.new_end <= length && "Invalid edit");
+
+    Token*              old         = lexer->tokens.items;
+    const size_t        old_count   = p->token_count;
+    const char*         old_source  = lexer->target;
+    const DtParserItems items       = p->items;
+    const long long     delta       = (long long) edit.new_end - (long long) edit.old_end;
+#define ITEM_OFFSET(I) ((long long) old[items.items[I].begin].offset)
+
+    // items [damaged, kept) are lexed again
+    size_t lo = 0, hi = items.count;
+    while(lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ITEM_OFFSET(mid) < (long long) edit.start) lo = mid + 1;
+        else hi = mid;
+    }
+    const size_t damaged = lo ? lo - 1 : 0;
+    const size_t begin   = lo ? items.items[damaged].begin : 0;
+    size_t       kept    = lo;
+
+    Tokenizer_retarget(lexer, source, length);
+    lexer->position = lo ? old[begin].offset : 0;
+
+    Tokens fresh = {
+        .items      = malloc((old_count + 32) * sizeof(Token)),
+        .count      = begin,
+        .capacity   = old_count + 32,
+    };
+    assert(fresh.items && "Failed to allocate tokens");
+    memcpy(fresh.items, old, begin * sizeof(Token));
+
+    // first token of old item past the edit means that the rest is the same
+    Token t;
+    while((t = Tokenizer_next_token(lexer)).kind != TokenKind_EOF) {
+        if (t.offset >= edit.new_end) {
+            while(kept < items.count && ITEM_OFFSET(kept) + delta < t.offset) kept++;
+            if (kept < items.count && ITEM_OFFSET(kept) + delta == t.offset &&
+                dtp_token_same(old[items.items[kept].begin], old_source, t, source)) break;
+        }
+        da_append(&fresh, t);
+    }
+    if (t.kind == TokenKind_EOF) kept = items.count;
+#undef ITEM_OFFSET
+
+    const size_t end  = fresh.count;
+    const size_t tail = kept < items.count ? items.items[kept].begin : old_count;
+    if (kept == items.count) 
+        // lexed again, same as in dtp_lex
+        da_append(&fresh, Tokenizer_next_token(lexer));
+    for(size_t i = tail; kept < items.count && i <= old_count; i++) {
+        Token moved = old[i];
+        moved.offset += delta;
+        da_append(&fresh, moved);
+    }
+    lexer->tokens   = fresh;
+    lexer->position = length;
+    p->tokens       = fresh.items;
+    if (lexer->lines) TokenLines_edit(lexer->lines, source, edit.start, edit.old_end, edit.new_end);
+    p->stat->source = source;
+
+    // function declarations that can be reused
+    const size_t candidates = kept - damaged;
+    unsigned int* hashes = calloc(candidates + 1, sizeof(*hashes));
+    bool*         taken  = calloc(candidates + 1, sizeof(*taken));
+    assert(hashes && taken && "Failed to allocate incremental parse state");
+    loop(i, candidates) {
+        const DtParserItem* item = &items.items[damaged + i];
+        taken[i]  = item->node->kind != NK_FUNCTION_DECL;
+        hashes[i] = dtp_tokens_hash(old + item->begin, item->end - item->begin, old_source);
+        // reused ones are taken back below
+        p->dead_nodes += dtp_node_count(item->node);
+    }
+
+    p->items = (DtParserItems) {0};
+    loop(i, damaged) {
+        dtp_node_rebase(lexer, items.items[i].node, 0, 0);
+        da_append(&p->items, items.items[i]);
+    }
+
+    // same cuts as dtp_find_splits: `name (` at depth 0 right after `}`
+    DtNode* scratch = dtp_node_new(p);
+    scratch->kind   = NK_ROOT;
+    p->dead_nodes++;
+    size_t  pending = begin;
+    long    depth   = 0;
+    for(size_t i = begin; i < end; i++) {
+        const Token* tk = fresh.items;
+        if (tk[i].kind == TokenKind_symbol) {
+            switch(Token_symbol(tk[i])) {
+                case '{': case '(': case '[': depth++; break;
+                case '}': case ')': case ']': depth--; break;
+            }
+            continue;
+        }
+        if (depth != 0 || tk[i].kind != TokenKind_word || !dtp_match_sym(tk[i + 1], '(')) continue;
+        if (i != begin && !dtp_match_sym(tk[i - 1], '}')) continue;
+
+        const size_t span = dtp_function_span(tk, i, end);
+        if (!span) continue;
+        const unsigned int hash = dtp_tokens_hash(tk + i, span, source);
+
+        size_t found = candidates;
+        loop(c, candidates) {
+            const DtParserItem* item = &items.items[damaged + c];
+            if (taken[c] || hashes[c] != hash || item->end - item->begin != span) continue;
+            // layout has to be the same too, so that nodes can be moved as a whole
+            const Token* was = old + item->begin;
+            size_t same = 0;
+            while(same < span && dtp_token_same(was[same], old_source, tk[i + same], source) &&
+                  was[same].offset - was[0].offset == tk[i + same].offset - tk[i].offset) same++;
+            if (same == span) { found = c; break; }
+        }
+        if (found == candidates) continue;
+
+        dtp_parse_range(p, scratch, pending, i);
+        DtParserItem item = items.items[damaged + found];
+        taken[found]   = true;
+        p->dead_nodes -= dtp_node_count(item.node);
+        dtp_node_rebase(lexer, item.node, 
+                (long long) tk[i].offset - old[item.begin].offset, (long long) i - item.begin);
+        item.begin = i;
+        item.end   = i + span;
+        da_append(&p->items, item);
+        pending = i + span;
+        i       = pending - 1;
+    }
+    dtp_parse_range(p, scratch, pending, end);
+
+    for(size_t i = kept; i < items.count; i++) {
+        DtParserItem item = items.items[i];
+        dtp_node_rebase(lexer, item.node, delta, (long long) end - tail);
+        item.begin = item.begin - tail + end;
+        item.end   = item.end   - tail + end;
+        da_append(&p->items, item);
+    }
+
+    DtNode* root = p->root;
+    root->children = root->last_child = NULL;
+    loop(i, p->items.count) {
+        DtNode* node = p->items.items[i].node;
+        node->next = NULL;
+        dtp_node_append(root, node);
+    }
+
+    p->token_count   = fresh.count - 1;
+    p->cursor        = p->token_count;
+    p->current       = p->token_count;
+    p->current_token = fresh.items[p->token_count];
+
+    free(old);
+    free(items.items);
+    free(hashes);
+    free(taken);
+
+    if (p->dead_nodes > PARSER_REPARSE_MIN_DEAD && 2 * p->dead_nodes > p->node_count)
+        return dtp_parse_again(p);
+    return root;
+}
+
+void dtp_free(DtParser* p) {
+    Tokenizer_free(&p->lexer);
+    arena_reset(&p->nodes);
+    free(p->items.items);
+    p->items        = (DtParserItems) {0};
+    p->node_count   = 0;
+    p->dead_nodes   = 0;
+    p->tokens       = NULL;
+    p->token_count  = 0;
+    p->root         = NULL;
+}
+
 DtNode* dtp_node_index(DtNode* node, size_t i) {
     size_t counter = 0;
     DtNode* next = node;
@@ -2034,6 +3557,7 @@ DtNode* dtp_node_get(DtNode* node, DtNodeKind kind) {
 void dtp_print_ast(DtNode* node, int depth, FILE* output_redir) {
     if (!node) return;
     DtNode* list = node;
+    char    temp[TOKENIZER_TEMP_CSTR_CAPACITY];
     while(list) {
         fprintf(output_redir, 
                 "%*s%s: "
@@ -2043,7 +3567,11 @@ void dtp_print_ast(DtNode* node, int depth, FILE* output_redir) {
                 DT_NODE_KIND_STR[list->kind],
 
                 (list->properties & NKP_HAS_UNARY) ? '-' : ' ',
-                Token_text_cstr(list->identifier)
+                __tkn_temp_cstr(
+                    list->identifier, 
+                    (TknSlice) { list->text, list->identifier.length },
+                    TokenizerPrintFlag_display_text, 
+                    temp, sizeof(temp))
         );
 
         //fprintf(output_redir, " -> %i", list->value.type);
@@ -2056,3 +3584,5 @@ void dtp_print_ast(DtNode* node, int depth, FILE* output_redir) {
 }
 
 
+
+#include "ast.c"
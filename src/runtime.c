@@ -0,0 +1,132 @@
+#include "vm.c"
+
+//
+// RUNTIME
+//
+// Keeps a program between runs. dtrt_lock gives tree of the source, when
+// source did not change since image of its AST was written, tree is made
+// from the image and input is not tokenized or parsed at all. Otherwise
+// source is parsed, optimized (see opt.c) and image is written for the
+// next time. dtrt_run runs the tree on the VM (see vm.c) when all of it
+// compiles, and by walking it otherwise.
+//
+#ifndef __DT_RUNTIME_H
+#define __DT_RUNTIME_H
+
+typedef struct {
+    const char*     file_name;
+    const char*     image_path; // AST image cache, NULL turns it off
+    bool            lazy;       // bodies are parsed on first call, see DtParser
+
+    DtStatus        status;
+    DtParser        parser;     // used when there was no image
+    DtAstImage      image;
+    Arena           nodes;      // tree made from image
+    DtNode*         root;
+    bool            from_image;
+    DtOptStats      opt;        // of the last parse, zero for image
+
+    // made by first dtrt_run after lock
+    DtVm            vm;
+    dt_enum8        vm_state;
+    DtContext       walker;     // when tree does not compile
+} DtRuntime;
+
+enum {
+    DTRT_VM_NONE = 0,
+    DTRT_VM_READY,
+    DTRT_VM_UNSUPPORTED,
+};
+
+void dtrt_unlock(DtRuntime* rt) {
+    dtp_free(&rt->parser);
+    TokenLines_free(&rt->status.lines);
+    loop(i, rt->status.errors.count) free((void*) rt->status.errors.items[i]);
+    free((void*) rt->status.errors.items);
+    sb_clear(&rt->status.error_builder);
+    rt->status = (DtStatus) {0};
+    rt->parser = (DtParser) {0};
+
+    dta_image_close(&rt->image);
+    arena_reset(&rt->nodes);
+    rt->root       = NULL;
+    rt->from_image = false;
+    rt->opt        = (DtOptStats) {0};
+
+    dtvm_free(&rt->vm);
+    rt->vm_state   = DTRT_VM_NONE;
+    dto_scope_clear(&rt->walker.functions);
+    arena_reset(&rt->walker.main_allocator);
+    arena_reset(&rt->walker.name_allocator);
+    free(rt->walker.stack);
+    rt->walker     = (DtContext) {0};
+}
+
+// `source` has to outlive the tree, unless it came from the image
+DtNode* dtrt_lock(DtRuntime* rt, const char* source, size_t length) {
+    if (rt->image_path && dta_image_load(&rt->image, rt->image_path, source, length)) {
+        rt->root       = dta_to_tree(&rt->image.ast, &rt->nodes);
+        rt->from_image = true;
+        return rt->root;
+    }
+
+    rt->status = (DtStatus) {
+        .file_name  = rt->file_name,
+        .source     = source,
+    };
+    rt->parser = (DtParser) {
+        .lexer      = DtTokenizer_init(source, length),
+        .stat       = &rt->status,
+        .lazy       = rt->lazy,
+    };
+    rt->root = dtp_parse(&rt->parser, 0);
+    rt->opt  = dtopt_run(rt->root);
+
+    // lazy bodies are not parsed yet, image would have them empty
+    if (rt->root && !rt->status.abort && rt->image_path && !rt->lazy) {
+        DtAst ast = dta_from_tree(rt->root);
+        if (!dta_image_write(rt->image_path, &ast, &rt->parser.lexer.symbols, source, length))
+            fprintf(stderr, "RUNTIME: failed to write AST image '%s'\n", rt->image_path);
+        dta_free(&ast);
+    }
+    return rt->root;
+}
+
+// source changed, old tree is dropped
+DtNode* dtrt_relock(DtRuntime* rt, const char* source, size_t length) {
+    dtrt_unlock(rt);
+    return dtrt_lock(rt, source, length);
+}
+
+// return value of `main` of locked tree
+DtObject dtrt_run(DtRuntime* rt) {
+    assert(rt->root && "dtrt_lock first");
+    DtParser* parser = rt->from_image ? NULL : &rt->parser;
+
+    if (rt->vm_state == DTRT_VM_NONE) {
+        rt->vm.parser = parser;
+        rt->vm_state  = dtvm_compile(&rt->vm, rt->root) ? DTRT_VM_READY : DTRT_VM_UNSUPPORTED;
+    }
+
+    if (rt->vm_state == DTRT_VM_READY) {
+        const long int entry = dtvm_find(&rt->vm, dto_ident("main"));
+        if (entry < 0) return dto_object_error(DT_ERROR_UNKOWN_TYPE);
+        DtObject ret = dtvm_call(&rt->vm, (size_t) entry, NULL, 0);
+        if (rt->vm.error[0]) fprintf(stderr, "RUNTIME: %s\n", rt->vm.error);
+        return ret;
+    }
+
+    if (!rt->walker.functions.objects) {
+        rt->walker = (DtContext) {
+            .functions  = dto_scope_init(),
+            .parser     = parser,
+        };
+        dte_eval_prepass(&rt->walker, rt->root);
+        dte_resolve(&rt->walker, rt->root);
+    }
+    DtObject entry = dto_scope_get(&rt->walker.functions, dto_ident("main"));
+    if (entry.value.type != DT_TYPE_FUNCTION) return dto_object_error(DT_ERROR_UNKOWN_TYPE);
+    return dte_eval_function(&rt->walker, (DtNode*) entry.value.as_function.entry);
+}
+
+#endif // __DT_RUNTIME_H
@@ -0,0 +1,220 @@
+#include "common.c"
+
+//
+// SCANNING KERNELS
+//
+// Used by tokenizer to find the end of a run of bytes that belong
+// to one character class (identifier, digits, spaces) 16 or 32 bytes
+// at a time. Kernel set is picked once at runtime from cpu features,
+// scalar version is always available as a fallback.
+//
+#ifndef __DT_SCAN_H
+#define __DT_SCAN_H
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__)) && !defined(DT_SCAN_SCALAR_ONLY)
+#   define DT_SCAN_X86
+#   include <immintrin.h>
+#endif
+
+typedef enum {
+    TKN_SCAN_IDENT,     // [A-Za-z0-9_]
+    TKN_SCAN_DIGIT,     // [0-9]
+    TKN_SCAN_SPACE,     // [ \t]
+    TKN_SCAN_CLASS_COUNT,
+} TknScanClass;
+
+// returns number of leading bytes of `s` (at most `len`) that are in class
+typedef size_t (*TknScanFn)(const char* s, size_t len);
+// returns number of occurrences of `c` in first `len` bytes of `s`
+typedef size_t (*TknCountFn)(const char* s, size_t len, char c);
+
+typedef struct {
+    const char* name;
+    TknScanFn   run[TKN_SCAN_CLASS_COUNT];
+    TknCountFn  count;
+} TknScanKernels;
+
+
+//
+// scalar
+//
+
+static inline bool __tkn_scan_is_ident(unsigned char c) {
+    unsigned char lower = c | 0x20;
+    return (lower >= 'a' && lower <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+size_t tkn_scan_ident_scalar(const char* s, size_t len) {
+    size_t i = 0;
+    while(i < len && __tkn_scan_is_ident(s[i])) i++;
+    return i;
+}
+
+size_t tkn_scan_digit_scalar(const char* s, size_t len) {
+    size_t i = 0;
+    while(i < len && s[i] >= '0' && s[i] <= '9') i++;
+    return i;
+}
+
+size_t tkn_scan_space_scalar(const char* s, size_t len) {
+    size_t i = 0;
+    while(i < len && (s[i] == ' ' || s[i] == '\t')) i++;
+    return i;
+}
+
+size_t tkn_count_byte_scalar(const char* s, size_t len, char c) {
+    size_t n = 0;
+    for(size_t i = 0; i < len; i++) n += (s[i] == c);
+    return n;
+}
+
+const TknScanKernels TKN_SCAN_SCALAR = {
+    .name = "scalar",
+    .run  = {
+        [TKN_SCAN_IDENT] = tkn_scan_ident_scalar,
+        [TKN_SCAN_DIGIT] = tkn_scan_digit_scalar,
+        [TKN_SCAN_SPACE] = tkn_scan_space_scalar,
+    },
+    .count = tkn_count_byte_scalar,
+};
+
+#ifdef DT_SCAN_X86
+
+//
+// SSE2
+//
+
+// unsigned range check: (x - lo) <= (hi - lo)
+#define TKN_SSE2_RANGE(X, LO, HI) \
+    _mm_cmpeq_epi8( \
+        _mm_min_epu8(_mm_sub_epi8((X), _mm_set1_epi8(LO)), _mm_set1_epi8((HI) - (LO))), \
+        _mm_sub_epi8((X), _mm_set1_epi8(LO)))
+
+static inline __m128i __tkn_sse2_ident(__m128i x) {
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    return _mm_or_si128(
+            _mm_or_si128(TKN_SSE2_RANGE(lower, 'a', 'z'), TKN_SSE2_RANGE(x, '0', '9')),
+            _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+}
+
+static inline __m128i __tkn_sse2_digit(__m128i x) {
+    return TKN_SSE2_RANGE(x, '0', '9');
+}
+
+static inline __m128i __tkn_sse2_space(__m128i x) {
+    return _mm_or_si128(
+            _mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+            _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+}
+
+#define TKN_SCAN_SSE2_IMPL(NAME, CLASSIFY, SCALAR) \
+size_t NAME(const char* s, size_t len) { \
+    size_t i = 0; \
+    for(; i + 16 <= len; i += 16) { \
+        __m128i x = _mm_loadu_si128((const __m128i*)(s + i)); \
+        unsigned int miss = ~(unsigned int)_mm_movemask_epi8(CLASSIFY(x)) & 0xFFFF; \
+        if (miss) return i + __builtin_ctz(miss); \
+    } \
+    return i + SCALAR(s + i, len - i); \
+}
+
+TKN_SCAN_SSE2_IMPL(tkn_scan_ident_sse2, __tkn_sse2_ident, tkn_scan_ident_scalar)
+TKN_SCAN_SSE2_IMPL(tkn_scan_digit_sse2, __tkn_sse2_digit, tkn_scan_digit_scalar)
+TKN_SCAN_SSE2_IMPL(tkn_scan_space_sse2, __tkn_sse2_space, tkn_scan_space_scalar)
+
+size_t tkn_count_byte_sse2(const char* s, size_t len, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t n = 0, i = 0;
+    for(; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(s + i));
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, needle)));
+    }
+    return n + tkn_count_byte_scalar(s + i, len - i, c);
+}
+
+const TknScanKernels TKN_SCAN_SSE2 = {
+    .name = "sse2",
+    .run  = {
+        [TKN_SCAN_IDENT] = tkn_scan_ident_sse2,
+        [TKN_SCAN_DIGIT] = tkn_scan_digit_sse2,
+        [TKN_SCAN_SPACE] = tkn_scan_space_sse2,
+    },
+    .count = tkn_count_byte_sse2,
+};
+
+//
+// AVX2
+//
+
+#define TKN_AVX2 __attribute__((target("avx2")))
+
+#define TKN_AVX2_RANGE(X, LO, HI) \
+    _mm256_cmpeq_epi8( \
+        _mm256_min_epu8(_mm256_sub_epi8((X), _mm256_set1_epi8(LO)), _mm256_set1_epi8((HI) - (LO))), \
+        _mm256_sub_epi8((X), _mm256_set1_epi8(LO)))
+
+static inline TKN_AVX2 __m256i __tkn_avx2_ident(__m256i x) {
+    __m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(
+            _mm256_or_si256(TKN_AVX2_RANGE(lower, 'a', 'z'), TKN_AVX2_RANGE(x, '0', '9')),
+            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+}
+
+static inline TKN_AVX2 __m256i __tkn_avx2_digit(__m256i x) {
+    return TKN_AVX2_RANGE(x, '0', '9');
+}
+
+static inline TKN_AVX2 __m256i __tkn_avx2_space(__m256i x) {
+    return _mm256_or_si256(
+            _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+            _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')));
+}
+
+#define TKN_SCAN_AVX2_IMPL(NAME, CLASSIFY, TAIL) \
+TKN_AVX2 size_t NAME(const char* s, size_t len) { \
+    size_t i = 0; \
+    for(; i + 32 <= len; i += 32) { \
+        __m256i x = _mm256_loadu_si256((const __m256i*)(s + i)); \
+        unsigned int miss = ~(unsigned int)_mm256_movemask_epi8(CLASSIFY(x)); \
+        if (miss) return i + __builtin_ctz(miss); \
+    } \
+    return i + TAIL(s + i, len - i); \
+}
+
+TKN_SCAN_AVX2_IMPL(tkn_scan_ident_avx2, __tkn_avx2_ident, tkn_scan_ident_sse2)
+TKN_SCAN_AVX2_IMPL(tkn_scan_digit_avx2, __tkn_avx2_digit, tkn_scan_digit_sse2)
+TKN_SCAN_AVX2_IMPL(tkn_scan_space_avx2, __tkn_avx2_space, tkn_scan_space_sse2)
+
+TKN_AVX2 size_t tkn_count_byte_avx2(const char* s, size_t len, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t n = 0, i = 0;
+    for(; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(s + i));
+        n += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, needle)));
+    }
+    return n + tkn_count_byte_sse2(s + i, len - i, c);
+}
+
+const TknScanKernels TKN_SCAN_AVX2 = {
+    .name = "avx2",
+    .run  = {
+        [TKN_SCAN_IDENT] = tkn_scan_ident_avx2,
+        [TKN_SCAN_DIGIT] = tkn_scan_digit_avx2,
+        [TKN_SCAN_SPACE] = tkn_scan_space_avx2,
+    },
+    .count = tkn_count_byte_avx2,
+};
+
+#endif // DT_SCAN_X86
+
+// pick the widest kernel set this cpu supports
+const TknScanKernels* tkn_scan_kernels(void) {
+#ifdef DT_SCAN_X86
+    if (__builtin_cpu_supports("avx2")) return &TKN_SCAN_AVX2;
+    return &TKN_SCAN_SSE2; // always present on x86_64
+#else
+    return &TKN_SCAN_SCALAR;
+#endif
+}
+
+#endif // __DT_SCAN_H
@@ -0,0 +1,737 @@
+#include "opt.c"
+
+//
+// BYTECODE VM
+//
+// Functions are compiled from the tree to register code. Arguments, locals
+// and temporaries of a call are registers of one frame, frames are laid
+// out on one stack and callee frame starts at the register its first
+// argument was put to, so arguments are never copied. Operators go through
+// dto_object_binop/compare/unary, ints of the same kind are done in place
+// the way those would do them.
+//
+// Instruction is 32 bits: opcode, register A, and either operands B and C
+// or one 16 bit operand Bx (constant, function, jump offset). Operands of
+// binary operators with DTVM_RK_CONSTANT set are constants instead of
+// registers. Registers hold only values, identifier and links of them are
+// always zero, so operators write just DtValue.
+//
+#ifndef __DT_VM_H
+#define __DT_VM_H
+
+#if defined(__GNUC__) && !defined(DTVM_SWITCH_DISPATCH)
+#   define DTVM_COMPUTED_GOTO
+#endif
+
+#ifndef DTVM_STACK_REGISTERS
+#   define DTVM_STACK_REGISTERS (1 << 14)
+#endif
+
+#define DTVM_MAX_REGISTERS  128
+#define DTVM_RK_CONSTANT    0x80
+#define DTVM_MAX_OPERAND    0xFFFF
+#define DTVM_JUMP_BIAS      0x7FFF
+
+typedef unsigned int DtVmInstr;
+
+#define DTVM_OP(I)  ((I) & 0xFF)
+#define DTVM_A(I)   (((I) >> 8)  & 0xFF)
+#define DTVM_B(I)   (((I) >> 16) & 0xFF)
+#define DTVM_C(I)   (((I) >> 24) & 0xFF)
+#define DTVM_BX(I)  ((I) >> 16)
+#define DTVM_SBX(I) ((int) DTVM_BX(I) - DTVM_JUMP_BIAS)
+
+typedef enum {
+    DTVM_OP_LOADK,  // A = K[Bx]
+    DTVM_OP_MOVE,   // A = B
+    DTVM_OP_ADD,    // A = RK(B) + RK(C)
+    DTVM_OP_SUB,    // A = RK(B) - RK(C)
+    DTVM_OP_MUL,    // A = RK(B) * RK(C)
+    DTVM_OP_DIV,    // A = RK(B) / RK(C)
+    DTVM_OP_EQ,     // A = RK(B) == RK(C)
+    DTVM_OP_NE,     // A = RK(B) != RK(C)
+    DTVM_OP_LT,     // A = RK(B) < RK(C)
+    DTVM_OP_LE,     // A = RK(B) <= RK(C)
+    DTVM_OP_GT,     // A = RK(B) > RK(C)
+    DTVM_OP_GE,     // A = RK(B) >= RK(C)
+    DTVM_OP_NEG,    // A = -B
+    DTVM_OP_NOT,    // A = !B
+    DTVM_OP_JMP,    // pc += sBx
+    DTVM_OP_JMPF,   // if !A: pc += sBx
+    DTVM_OP_CALL,   // A = F[Bx](A, A+1, ...)
+    DTVM_OP_TAILCALL,// return F[Bx](A, A+1, ...) in this frame
+    DTVM_OP_RET,    // return A
+    DTVM_OP_RETN,   // return null
+    DTVM_OP_COUNT,
+} DtVmOp;
+
+const char* DTVM_OP_STR[] = {
+    [DTVM_OP_LOADK] = "loadk",
+    [DTVM_OP_MOVE]  = "move",
+    [DTVM_OP_ADD]   = "add",
+    [DTVM_OP_SUB]   = "sub",
+    [DTVM_OP_MUL]   = "mul",
+    [DTVM_OP_DIV]   = "div",
+    [DTVM_OP_EQ]    = "eq",
+    [DTVM_OP_NE]    = "ne",
+    [DTVM_OP_LT]    = "lt",
+    [DTVM_OP_LE]    = "le",
+    [DTVM_OP_GT]    = "gt",
+    [DTVM_OP_GE]    = "ge",
+    [DTVM_OP_NEG]   = "neg",
+    [DTVM_OP_NOT]   = "not",
+    [DTVM_OP_JMP]   = "jmp",
+    [DTVM_OP_JMPF]  = "jmpf",
+    [DTVM_OP_CALL]  = "call",
+    [DTVM_OP_TAILCALL] = "tailcall",
+    [DTVM_OP_RET]   = "ret",
+    [DTVM_OP_RETN]  = "retn",
+};
+
+typedef struct {
+    DtIdentifer     name;
+    DtNode*         decl;
+    dt_enum8        return_type;
+    unsigned short  arity;
+    unsigned short  locals;     // arguments included, zeroed on call
+    unsigned short  registers;  // locals and temporaries
+    size_t          entry;      // first instruction in DtVm.code
+    size_t          constants;  // first constant in DtVm.constants
+} DtVmFunc;
+
+typedef struct {
+    DtVmFunc*   items;
+    size_t      count, capacity;
+} DtVmFuncs;
+
+typedef struct {
+    DtVmInstr*  items;
+    size_t      count, capacity;
+} DtVmCode;
+
+typedef struct {
+    DtObject*   items;
+    size_t      count, capacity;
+} DtVmConstants;
+
+typedef struct {
+    const DtVmFunc*     func;
+    const DtVmInstr*    pc;     // of caller, after the call
+    DtObject*           base;   // of caller
+} DtVmFrame;
+
+typedef struct {
+    DtVmFuncs       functions;
+    DtVmCode        code;
+    DtVmConstants   constants;
+    long int*       by_symbol;  // 1 + function index, by symbol id of name
+    size_t          by_symbol_count;
+
+    DtObject*       stack;      // registers of all frames
+    DtVmFrame       frames[DT_MAX_CALL_DEPTH];
+
+    // DtParser* that made the tree, lazy bodies are parsed through it
+    void*           parser;
+    char            error[256]; // of last dtvm_compile or dtvm_call
+} DtVm;
+
+void dtvm_free(DtVm* vm) {
+    free(vm->functions.items);
+    free(vm->code.items);
+    free(vm->constants.items);
+    free(vm->by_symbol);
+    free(vm->stack);
+    *vm = (DtVm) { .parser = vm->parser };
+}
+
+static inline DtVmInstr dtvm_abc(DtVmOp op, int a, int b, int c) {
+    return (DtVmInstr) op | (DtVmInstr) a << 8 | (DtVmInstr) b << 16 | (DtVmInstr) c << 24;
+}
+
+static inline DtVmInstr dtvm_abx(DtVmOp op, int a, unsigned int bx) {
+    return (DtVmInstr) op | (DtVmInstr) a << 8 | (DtVmInstr) bx << 16;
+}
+
+// index of function or -1
+long int dtvm_find(const DtVm* vm, DtIdentifer name) {
+    if (name.id && name.id < vm->by_symbol_count && vm->by_symbol[name.id])
+        return vm->by_symbol[name.id] - 1;
+    loop(i, vm->functions.count)
+        if (!name.id || !vm->functions.items[i].name.id)
+            if (dte_same_ident(vm->functions.items[i].name, name)) return (long int) i;
+    return -1;
+}
+
+//
+// COMPILER
+//
+
+typedef struct {
+    DtVm*       vm;
+    DtVmFunc*   func;
+    int         local_count; // slots of resolved frame
+    int         top;        // first free register
+    bool        failed;
+} DtVmCompiler;
+
+void __dtvm_fail(DtVmCompiler* c, const DtNode* node, const char* what) {
+    if (c->failed) return;
+    c->failed = true;
+    Slice text = dtp_node_text(node);
+    snprintf(c->vm->error, sizeof(c->vm->error), "%.*s(): %s (%s '%.*s')",
+            (int) c->func->name.length, c->func->name.name, what,
+            DT_NODE_KIND_STR[node->kind], (int) text.length, text.data ? text.data : "");
+}
+
+size_t __dtvm_emit(DtVmCompiler* c, DtVmInstr i) {
+    da_append(&c->vm->code, i);
+    return c->vm->code.count - 1;
+}
+
+int __dtvm_alloc(DtVmCompiler* c, const DtNode* node) {
+    if (c->top >= DTVM_MAX_REGISTERS) {
+        __dtvm_fail(c, node, "too many registers");
+        return 0;
+    }
+    const int r = c->top++;
+    if (c->top > c->func->registers) c->func->registers = c->top;
+    return r;
+}
+
+unsigned int __dtvm_constant(DtVmCompiler* c, const DtNode* node, DtObject v) {
+    DtVmConstants* k = &c->vm->constants;
+    for(size_t i = c->func->constants; i < k->count; i++) {
+        if (k->items[i].value.type       == v.value.type &&
+            k->items[i].value.properties == v.value.properties &&
+            k->items[i].value.as_long    == v.value.as_long)
+            return (unsigned int)(i - c->func->constants);
+    }
+    if (k->count - c->func->constants > DTVM_MAX_OPERAND) {
+        __dtvm_fail(c, node, "too many constants");
+        return 0;
+    }
+    da_append(k, (DtObject) { .value = v.value });
+    return (unsigned int)(k->count - 1 - c->func->constants);
+}
+
+// jump at `at` goes to the next instruction emitted
+void __dtvm_patch(DtVmCompiler* c, size_t at, const DtNode* node) {
+    const long int offset = (long int) c->vm->code.count - (long int) at - 1;
+    if (offset + DTVM_JUMP_BIAS > DTVM_MAX_OPERAND) {
+        __dtvm_fail(c, node, "jump is too long");
+        return;
+    }
+    DtVmInstr* i = &c->vm->code.items[at];
+    *i = dtvm_abx(DTVM_OP(*i), DTVM_A(*i), (unsigned int)(offset + DTVM_JUMP_BIAS));
+}
+
+int __dtvm_expr(DtVmCompiler* c, DtNode* node);
+
+// operand of binary operator, literal is used straight from constants
+int __dtvm_operand(DtVmCompiler* c, DtNode* node) {
+    const bool is_literal = node->kind == NK_BOOLIT || node->kind == NK_INTLIT || node->kind == NK_FLTLIT;
+    if (is_literal && !(node->properties & (NKP_HAS_UNARY | NKP_HAS_NOT))) {
+        const unsigned int k = __dtvm_constant(c, node, dte_object_from_numeric_literall(node));
+        if (k < DTVM_RK_CONSTANT) return (int)(DTVM_RK_CONSTANT | k);
+    }
+    return __dtvm_expr(c, node);
+}
+
+// value of `node` goes to register `dst`
+void __dtvm_expr_to(DtVmCompiler* c, DtNode* node, int dst) {
+    const size_t before = c->vm->code.count;
+    const int    r      = __dtvm_expr(c, node);
+    if (r == dst || c->failed) return;
+
+    // temporary made by last instruction, it can write to `dst` itself
+    DtVmInstr* last = c->vm->code.count > before ? &c->vm->code.items[c->vm->code.count - 1] : NULL;
+    if (last && r >= c->local_count && (int) DTVM_A(*last) == r &&
+            DTVM_OP(*last) != DTVM_OP_CALL) {
+        *last = (*last & ~(DtVmInstr) 0xFF00) | (DtVmInstr) dst << 8;
+        return;
+    }
+    __dtvm_emit(c, dtvm_abc(DTVM_OP_MOVE, dst, r, 0));
+}
+
+// `op` is DTVM_OP_CALL or DTVM_OP_TAILCALL
+int __dtvm_call(DtVmCompiler* c, DtNode* node, DtVmOp op) {
+    const long int callee = dtvm_find(c->vm, dte_ident_from_node(node));
+    if (callee < 0) {
+        __dtvm_fail(c, node, "call of unknown function");
+        return 0;
+    }
+
+    const int base  = c->top;
+    size_t    arity = 0;
+    for(DtNode* arg = node->children; arg; arg = arg->next, arity++) {
+        const int r = __dtvm_alloc(c, arg);
+        __dtvm_expr_to(c, arg, r);
+        c->top = r + 1;
+    }
+    if (arity != c->vm->functions.items[callee].arity) {
+        __dtvm_fail(c, node, "wrong number of arguments");
+        return 0;
+    }
+
+    // result register, arguments did not take it
+    if (arity == 0 && op == DTVM_OP_CALL) __dtvm_alloc(c, node);
+    __dtvm_emit(c, dtvm_abx(op, base, (unsigned int) callee));
+    c->top = base + 1;
+    return base;
+}
+
+// register that holds value of `node`, temporaries above c->top
+int __dtvm_expr(DtVmCompiler* c, DtNode* node) {
+    int r = 0;
+    if (c->failed) return 0;
+
+    switch(node->kind) {
+        case NK_BOOLIT:
+        case NK_INTLIT:
+        case NK_FLTLIT:
+            r = __dtvm_alloc(c, node);
+            __dtvm_emit(c, dtvm_abx(DTVM_OP_LOADK, r,
+                        __dtvm_constant(c, node, dte_object_from_numeric_literall(node))));
+            break;
+
+        case NK_IDENTIFIER:
+            if (!node->slot) {
+                __dtvm_fail(c, node, "unknown variable");
+                return 0;
+            }
+            r = node->slot - 1;
+            break;
+
+        case NK_EXPRESSION:
+            r = __dtvm_expr(c, node->children);
+            break;
+
+        case NK_TERM:
+        case NK_FACTOR:
+        case NK_EQALITY:
+        case NK_COMPARISON: {
+            DtVmOp op;
+            const int p = node->properties;
+            switch(node->kind) {
+                case NK_TERM:   op = (p & NKP_IS_ADD) ? DTVM_OP_ADD : DTVM_OP_SUB; break;
+                case NK_FACTOR: op = (p & NKP_IS_MUL) ? DTVM_OP_MUL : DTVM_OP_DIV; break;
+                case NK_EQALITY:op = (p & NKP_IS_EQALITY) ? DTVM_OP_EQ : DTVM_OP_NE; break;
+                default:
+                    op = (p & NKP_IS_CMP_GT) ?
+                        ((p & NKP_IS_CMP_EQ) ? DTVM_OP_GE : DTVM_OP_GT) :
+                        ((p & NKP_IS_CMP_EQ) ? DTVM_OP_LE : DTVM_OP_LT);
+                    break;
+            }
+            const int base = c->top;
+            const int lhs  = __dtvm_operand(c, node->children);
+            const int rhs  = __dtvm_operand(c, node->children->next);
+            c->top = base;
+            r = __dtvm_alloc(c, node);
+            __dtvm_emit(c, dtvm_abc(op, r, lhs, rhs));
+        } break;
+
+        case NK_FUNCTION_CALL:
+            r = __dtvm_call(c, node, DTVM_OP_CALL);
+            break;
+
+        default:
+            __dtvm_fail(c, node, "expression is not supported");
+            return 0;
+    }
+
+    // prefix operators, same order as dte_eval_expression
+    if (node->properties & (NKP_HAS_UNARY | NKP_HAS_NOT)) {
+        const int src = r;
+        if (r < c->local_count) r = __dtvm_alloc(c, node);
+        if (node->properties & NKP_HAS_UNARY) __dtvm_emit(c, dtvm_abc(DTVM_OP_NEG, r, src, 0));
+        if (node->properties & NKP_HAS_NOT)
+            __dtvm_emit(c, dtvm_abc(DTVM_OP_NOT, r, (node->properties & NKP_HAS_UNARY) ? r : src, 0));
+    }
+    return r;
+}
+
+void __dtvm_block(DtVmCompiler* c, DtNode* block);
+
+void __dtvm_statement(DtVmCompiler* c, DtNode* node) {
+    switch(node->kind) {
+        case NK_VARIABLE: {
+            DtNode* value = node->children;
+            if (!value || value->kind == NK_OBJECT || value->kind == NK_ARRAY) {
+                __dtvm_fail(c, node, "only numeric variables are supported");
+                return;
+            }
+            __dtvm_expr_to(c, value, node->slot - 1);
+        } break;
+
+        case NK_RETURN:
+            if (dte_tail_call(node))
+                __dtvm_call(c, dte_tail_call(node), DTVM_OP_TAILCALL);
+            else if (node->children)
+                __dtvm_emit(c, dtvm_abc(DTVM_OP_RET, __dtvm_expr(c, node->children), 0, 0));
+            else
+                __dtvm_emit(c, dtvm_abc(DTVM_OP_RETN, 0, 0, 0));
+            break;
+
+        // branches are NK_IF with condition and block, last one
+        // can have only block (else)
+        case NK_IF_STATEMENT: {
+            size_t exits[256];
+            size_t exit_count = 0;
+            for(DtNode* branch = node->children; branch && !c->failed; branch = branch->next) {
+                DtNode* cond  = branch->children->next ? branch->children : NULL;
+                DtNode* block = cond ? cond->next : branch->children;
+                size_t skip = 0;
+                if (cond) {
+                    skip = __dtvm_emit(c, dtvm_abx(DTVM_OP_JMPF, __dtvm_expr(c, cond), 0));
+                    c->top = c->local_count;
+                }
+                __dtvm_block(c, block);
+                if (branch->next) {
+                    if (exit_count == DT_ARRLEN(exits)) {
+                        __dtvm_fail(c, branch, "too many branches");
+                        return;
+                    }
+                    exits[exit_count++] = __dtvm_emit(c, dtvm_abx(DTVM_OP_JMP, 0, 0));
+                }
+                if (cond) __dtvm_patch(c, skip, branch);
+            }
+            loop(i, exit_count) __dtvm_patch(c, exits[i], node);
+        } break;
+
+        // result is dropped
+        case NK_FUNCTION_CALL:
+            __dtvm_call(c, node, DTVM_OP_CALL);
+            break;
+
+        default:
+            __dtvm_fail(c, node, "statement is not supported");
+            return;
+    }
+    c->top = c->local_count;
+}
+
+void __dtvm_block(DtVmCompiler* c, DtNode* block) {
+    for(DtNode* it = block->children; it && !c->failed; it = it->next)
+        __dtvm_statement(c, it);
+}
+
+bool __dtvm_function(DtVm* vm, DtVmFunc* func) {
+    DtVmCompiler c = { .vm = vm, .func = func };
+    DtNode* block = NULL;
+    for(DtNode* it = func->decl->children; it; it = it->next)
+        if (it->kind == NK_BLOCK) block = it;
+    assert(block && "Function declaration without body");
+
+    if (block->properties & NKP_IS_LAZY) {
+        if (!vm->parser) {
+            __dtvm_fail(&c, block, "lazy body without parser");
+            return false;
+        }
+        dtp_block_parse(vm->parser, block);
+    }
+
+    // locals are slots given by resolver, temporaries go above them
+    if (!(func->decl->properties & NKP_IS_RESOLVED))
+        dte_resolve_function(func->decl, NULL);
+    if (func->decl->slot > DTVM_MAX_REGISTERS) {
+        __dtvm_fail(&c, func->decl, "too many locals");
+        return false;
+    }
+    c.local_count = c.top = func->decl->slot;
+    func->locals    = func->decl->slot;
+    func->registers = func->decl->slot;
+    func->entry  = vm->code.count;
+    func->constants = vm->constants.count;
+
+    __dtvm_block(&c, block);
+    __dtvm_emit(&c, dtvm_abc(DTVM_OP_RETN, 0, 0, 0));
+    return !c.failed;
+}
+
+// whole tree or nothing, error says what could not be compiled
+bool dtvm_compile(DtVm* vm, DtNode* root) {
+    void* parser = vm->parser;
+    dtvm_free(vm);
+    vm->parser = parser;
+    vm->error[0] = 0;
+
+    for(DtNode* it = root ? root->children : NULL; it; it = it->next) {
+        if (it->kind != NK_FUNCTION_DECL) continue;
+        // arity is known before any body is compiled, calls check it
+        DtNode* type  = NULL;
+        size_t  arity = 0;
+        for(DtNode* part = it->children; part; part = part->next) {
+            if (part->kind == NK_TYPE) type = part;
+            if (part->kind == NK_FUNCTION_ARGS)
+                for(DtNode* arg = part->children; arg; arg = arg->next) arity++;
+        }
+
+        DtVmFunc func = {
+            .name        = dte_ident_from_node(it),
+            .decl        = it,
+            .return_type = dte_basic_type_from_ast(type),
+            .arity       = (unsigned short) arity,
+        };
+        if (vm->functions.count > DTVM_MAX_OPERAND) {
+            snprintf(vm->error, sizeof(vm->error), "too many functions");
+            return false;
+        }
+        da_append(&vm->functions, func);
+
+        const unsigned int id = func.name.id;
+        if (!id) continue;
+        if (id >= vm->by_symbol_count) {
+            size_t count = vm->by_symbol_count ? vm->by_symbol_count : 64;
+            while(count <= id) count *= 2;
+            vm->by_symbol = realloc(vm->by_symbol, count * sizeof(*vm->by_symbol));
+            assert(vm->by_symbol && "Failed to grow function index");
+            memset(vm->by_symbol + vm->by_symbol_count, 0, (count - vm->by_symbol_count) * sizeof(*vm->by_symbol));
+            vm->by_symbol_count = count;
+        }
+        vm->by_symbol[id] = (long int) vm->functions.count;
+    }
+
+    loop(i, vm->functions.count)
+        if (!__dtvm_function(vm, &vm->functions.items[i])) return false;
+
+    vm->stack = calloc(DTVM_STACK_REGISTERS, sizeof(*vm->stack));
+    assert(vm->stack && "Failed to allocate VM stack");
+    return true;
+}
+
+//
+// INTERPRETER
+//
+
+#define DTVM_RK(X) (((X) & DTVM_RK_CONSTANT) ? &K[(X) & ~DTVM_RK_CONSTANT] : &R[X])
+
+// both sides are ints of one kind, dto_object_binop/compare would not
+// convert anything
+#define DTVM_SAME_INTS(L, R) \
+    ((L)->value.type == DT_TYPE_INT && (R)->value.type == DT_TYPE_INT && \
+     (L)->value.properties == (R)->value.properties)
+
+// result as dto_object_binop/compare would make it, rest of union is
+// zero. `D` can be one of operands of `V`
+#define DTVM_SET(D, TYPE, FIELD, V) do { \
+    const DtValue v = { .type = (TYPE), .FIELD = (V) }; \
+    (D)->value.type       = v.type; \
+    (D)->value.properties = 0; \
+    (D)->value.as_long    = v.as_long; \
+} while(0)
+
+#define DTVM_ARITH(OP, BINOP) { \
+    const DtObject* l = DTVM_RK(DTVM_B(i)); \
+    const DtObject* r = DTVM_RK(DTVM_C(i)); \
+    if (DTVM_SAME_INTS(l, r)) DTVM_SET(&R[DTVM_A(i)], DT_TYPE_INT, as_int, l->value.as_int OP r->value.as_int); \
+    else R[DTVM_A(i)].value = dto_object_binop(*l, *r, BINOP).value; \
+}
+
+#define DTVM_COMPARE(FIELD, OP, COMPARE, NEGATE) { \
+    const DtObject* l = DTVM_RK(DTVM_B(i)); \
+    const DtObject* r = DTVM_RK(DTVM_C(i)); \
+    if (DTVM_SAME_INTS(l, r)) DTVM_SET(&R[DTVM_A(i)], DT_TYPE_BOOL, as_byte, l->value.FIELD OP r->value.FIELD); \
+    else { \
+        DtObject v = dto_object_compare(*l, *r, COMPARE); \
+        R[DTVM_A(i)].value = (NEGATE ? dto_object_unary(v, DT_UNARY_NOT) : v).value; \
+    } \
+}
+
+#ifdef DTVM_COMPUTED_GOTO
+#   define DTVM_CASE(OP)    L_##OP
+#   define DTVM_NEXT()      do { i = *pc++; goto *labels[DTVM_OP(i)]; } while(0)
+#else
+#   define DTVM_CASE(OP)    case OP
+#   define DTVM_NEXT()      goto dispatch
+#endif
+
+#ifdef DTVM_COMPUTED_GOTO
+#   pragma GCC diagnostic push
+#   pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+DtObject __dtvm_execute(DtVm* vm, const DtVmFunc* func, DtObject* R) {
+#ifdef DTVM_COMPUTED_GOTO
+    static const void* labels[DTVM_OP_COUNT] = {
+        [DTVM_OP_LOADK] = &&L_DTVM_OP_LOADK,
+        [DTVM_OP_MOVE]  = &&L_DTVM_OP_MOVE,
+        [DTVM_OP_ADD]   = &&L_DTVM_OP_ADD,
+        [DTVM_OP_SUB]   = &&L_DTVM_OP_SUB,
+        [DTVM_OP_MUL]   = &&L_DTVM_OP_MUL,
+        [DTVM_OP_DIV]   = &&L_DTVM_OP_DIV,
+        [DTVM_OP_EQ]    = &&L_DTVM_OP_EQ,
+        [DTVM_OP_NE]    = &&L_DTVM_OP_NE,
+        [DTVM_OP_LT]    = &&L_DTVM_OP_LT,
+        [DTVM_OP_LE]    = &&L_DTVM_OP_LE,
+        [DTVM_OP_GT]    = &&L_DTVM_OP_GT,
+        [DTVM_OP_GE]    = &&L_DTVM_OP_GE,
+        [DTVM_OP_NEG]   = &&L_DTVM_OP_NEG,
+        [DTVM_OP_NOT]   = &&L_DTVM_OP_NOT,
+        [DTVM_OP_JMP]   = &&L_DTVM_OP_JMP,
+        [DTVM_OP_JMPF]  = &&L_DTVM_OP_JMPF,
+        [DTVM_OP_CALL]  = &&L_DTVM_OP_CALL,
+        [DTVM_OP_TAILCALL] = &&L_DTVM_OP_TAILCALL,
+        [DTVM_OP_RET]   = &&L_DTVM_OP_RET,
+        [DTVM_OP_RETN]  = &&L_DTVM_OP_RETN,
+    };
+#endif
+    DtObject* const  stack_end = vm->stack + DTVM_STACK_REGISTERS;
+    const DtVmInstr* code      = vm->code.items;
+    const DtVmInstr* pc        = code + func->entry;
+    const DtObject*  K         = vm->constants.items + func->constants;
+    size_t           depth     = 0;
+    DtValue          ret       = DT_OBJECT_NULL.value;
+    DtVmInstr        i;
+
+#ifdef DTVM_COMPUTED_GOTO
+    DTVM_NEXT();
+#else
+dispatch:
+    i = *pc++;
+    switch(DTVM_OP(i)) {
+#endif
+
+    DTVM_CASE(DTVM_OP_LOADK):   R[DTVM_A(i)].value = K[DTVM_BX(i)].value;           DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_MOVE):    R[DTVM_A(i)].value = R[DTVM_B(i)].value;            DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_ADD):     DTVM_ARITH(+, DT_BINOP_ADD)                         DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_SUB):     DTVM_ARITH(-, DT_BINOP_SUB)                         DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_MUL):     DTVM_ARITH(*, DT_BINOP_MUL)                         DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_DIV): {
+        // ints that trap are left to dto_object_binop, so they trap the same
+        const DtObject* l = DTVM_RK(DTVM_B(i));
+        const DtObject* r = DTVM_RK(DTVM_C(i));
+        if (DTVM_SAME_INTS(l, r) && r->value.as_int != 0 && 
+                !(r->value.as_int == -1 && l->value.as_int == INT_MIN))
+            DTVM_SET(&R[DTVM_A(i)], DT_TYPE_INT, as_int, l->value.as_int / r->value.as_int);
+        else R[DTVM_A(i)].value = dto_object_binop(*l, *r, DT_BINOP_DIV).value;
+    } DTVM_NEXT();
+    // equality of numbers is on all 64 bits, as dto_object_compare does
+    DTVM_CASE(DTVM_OP_EQ):      DTVM_COMPARE(as_long, ==, DT_COMPARE_EQ, false)     DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_NE):      DTVM_COMPARE(as_long, !=, DT_COMPARE_EQ, true)      DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_LT):      DTVM_COMPARE(as_int, <,  DT_COMPARE_LT, false)      DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_LE):      DTVM_COMPARE(as_int, <=, DT_COMPARE_LT | DT_COMPARE_EQWITH, false) DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_GT):      DTVM_COMPARE(as_int, >,  DT_COMPARE_GT, false)      DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_GE):      DTVM_COMPARE(as_int, >=, DT_COMPARE_GT | DT_COMPARE_EQWITH, false) DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_NEG):     R[DTVM_A(i)].value = dto_object_unary(R[DTVM_B(i)], DT_UNARY_NEG).value; DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_NOT):     R[DTVM_A(i)].value = dto_object_unary(R[DTVM_B(i)], DT_UNARY_NOT).value; DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_JMP):     pc += DTVM_SBX(i);                                  DTVM_NEXT();
+    DTVM_CASE(DTVM_OP_JMPF):    if (!R[DTVM_A(i)].value.as_byte) pc += DTVM_SBX(i); DTVM_NEXT();
+
+    DTVM_CASE(DTVM_OP_CALL): {
+        const DtVmFunc* callee = &vm->functions.items[DTVM_BX(i)];
+        DtObject*       base   = R + DTVM_A(i);
+        if (depth == DT_MAX_CALL_DEPTH || base + callee->registers > stack_end) {
+            snprintf(vm->error, sizeof(vm->error), "%.*s(): call stack overflow",
+                    (int) callee->name.length, callee->name.name);
+            return dto_object_error(DTR_ERROR_STACK_OVERFLOW);
+        }
+        vm->frames[depth++] = (DtVmFrame) { func, pc, R };
+        memset(base + callee->arity, 0, (callee->locals - callee->arity) * sizeof(*base));
+        func = callee;
+        R    = base;
+        K    = vm->constants.items + func->constants;
+        pc   = code + func->entry;
+    } DTVM_NEXT();
+
+    // callee takes this frame, arguments move to its start and result
+    // goes where result of this function would
+    DTVM_CASE(DTVM_OP_TAILCALL): {
+        const DtVmFunc* callee = &vm->functions.items[DTVM_BX(i)];
+        if (R + callee->registers > stack_end) {
+            snprintf(vm->error, sizeof(vm->error), "%.*s(): call stack overflow",
+                    (int) callee->name.length, callee->name.name);
+            return dto_object_error(DTR_ERROR_STACK_OVERFLOW);
+        }
+        memmove(R, R + DTVM_A(i), callee->arity * sizeof(*R));
+        memset(R + callee->arity, 0, (callee->locals - callee->arity) * sizeof(*R));
+        func = callee;
+        K    = vm->constants.items + func->constants;
+        pc   = code + func->entry;
+    } DTVM_NEXT();
+
+    DTVM_CASE(DTVM_OP_RET):
+        ret = R[DTVM_A(i)].value;
+        goto leave;
+    DTVM_CASE(DTVM_OP_RETN):
+        ret = DT_OBJECT_NULL.value;
+        goto leave;
+
+#ifndef DTVM_COMPUTED_GOTO
+    default: assert(0 && "Unknown VM instruction");
+    }
+#endif
+
+    // result goes to register of the call, which is first of callee frame
+leave:
+    if (!depth) return (DtObject) { .value = ret };
+    R[0].value = ret;
+    const DtVmFrame* frame = &vm->frames[--depth];
+    func = frame->func;
+    pc   = frame->pc;
+    R    = frame->base;
+    K    = vm->constants.items + func->constants;
+    DTVM_NEXT();
+}
+
+#ifdef DTVM_COMPUTED_GOTO
+#   pragma GCC diagnostic pop
+#endif
+
+#undef DTVM_CASE
+#undef DTVM_NEXT
+#undef DTVM_RK
+#undef DTVM_SAME_INTS
+#undef DTVM_SET
+#undef DTVM_ARITH
+#undef DTVM_COMPARE
+
+// calls compiled function, error object and vm->error on failure
+DtObject dtvm_call(DtVm* vm, size_t func, const DtObject* args, size_t count) {
+    assert(vm->stack && "dtvm_compile first");
+    assert(func < vm->functions.count);
+    const DtVmFunc* f = &vm->functions.items[func];
+    vm->error[0] = 0;
+    if (count != f->arity) {
+        snprintf(vm->error, sizeof(vm->error), "%.*s(): expects %u arguments, got %zu",
+                (int) f->name.length, f->name.name, f->arity, count);
+        return dto_object_error(DT_ERROR_TYPE_MISSMATCH);
+    }
+    memset(vm->stack, 0, f->locals * sizeof(*vm->stack));
+    loop(i, count) vm->stack[i].value = args[i].value;
+    return __dtvm_execute(vm, f, vm->stack);
+}
+
+void dtvm_print_code(const DtVm* vm, FILE* f) {
+    loop(n, vm->functions.count) {
+        const DtVmFunc* func = &vm->functions.items[n];
+        const size_t end = n + 1 < vm->functions.count ?
+            vm->functions.items[n + 1].entry : vm->code.count;
+        fprintf(f, "%.*s: arity %u, locals %u, registers %u\n",
+                (int) func->name.length, func->name.name, func->arity, func->locals, func->registers);
+        for(size_t at = func->entry; at < end; at++) {
+            const DtVmInstr i = vm->code.items[at];
+            fprintf(f, "    %4zu  %-8s r%-3u ", at - func->entry, DTVM_OP_STR[DTVM_OP(i)], DTVM_A(i));
+            switch(DTVM_OP(i)) {
+                case DTVM_OP_LOADK: fprintf(f, "k%u\n", DTVM_BX(i)); break;
+                case DTVM_OP_CALL:
+                case DTVM_OP_TAILCALL: fprintf(f, "%.*s\n",
+                        (int) vm->functions.items[DTVM_BX(i)].name.length,
+                        vm->functions.items[DTVM_BX(i)].name.name); break;
+                case DTVM_OP_JMP:
+                case DTVM_OP_JMPF:  fprintf(f, "-> %zu\n", at - func->entry + 1 + DTVM_SBX(i)); break;
+                case DTVM_OP_MOVE:
+                case DTVM_OP_NEG:
+                case DTVM_OP_NOT:   fprintf(f, "r%u\n", DTVM_B(i)); break;
+                case DTVM_OP_RET:
+                case DTVM_OP_RETN:  fprintf(f, "\n"); break;
+                default:
+                    fprintf(f, "%c%u %c%u\n",
+                            (DTVM_B(i) & DTVM_RK_CONSTANT) ? 'k' : 'r', DTVM_B(i) & ~DTVM_RK_CONSTANT,
+                            (DTVM_C(i) & DTVM_RK_CONSTANT) ? 'k' : 'r', DTVM_C(i) & ~DTVM_RK_CONSTANT);
+                    break;
+            }
+        }
+    }
+}
+
+#endif // __DT_VM_H
@@ -0,0 +1,153 @@
+// AST image cache: first lock of each file writes the image, second one
+// has to load it and give the same tree and result. Corrupted images
+// have to be refused, the source is parsed again then
+//
+//  usage: image file.dt...
+#include "../src/runtime.c"
+
+#define IMAGE_PATH "build/image.img"
+
+// printed AST, caller frees
+char* ast_text(DtNode* root) {
+    FILE* f = tmpfile();
+    assert(f && "Failed to open temporary file");
+    dtp_print_ast(root, 0, f);
+    const long length = ftell(f);
+    char* text = malloc(length + 1);
+    rewind(f);
+    text[fread(text, 1, length, f)] = 0;
+    fclose(f);
+    return text;
+}
+
+// tree and value of `main`, caller frees both
+void lock_and_run(DtRuntime* rt, const char* source, char** tree, char* value, size_t cap) {
+    DtNode* root = dtrt_lock(rt, source, strlen(source));
+    *tree = root ? ast_text(root) : calloc(1, 1);
+    DtSerializeOpt opt = { .spacing = "" };
+    if (root) dto_serialize(value, cap, opt, dtrt_run(rt));
+    else      snprintf(value, cap, "no tree");
+}
+
+typedef enum {
+    DAMAGE_NONE,
+    DAMAGE_CYCLE,           // second node is its own child
+    DAMAGE_CHILD_COUNT,     // children past the last node
+    DAMAGE_FIRST_CHILD,
+    DAMAGE_TEXT,            // text spans past strings
+    DAMAGE_SYMBOL_TEXT,
+    DAMAGE_NODE_COUNT,      // count that overflows when multiplied
+    DAMAGE_KIND,
+    DAMAGE_TRUNCATED,
+    DAMAGE_COUNT,
+} Damage;
+
+const char* damage_names[] = {
+    [DAMAGE_NONE]        = "intact image",
+    [DAMAGE_CYCLE]       = "node that is its own child",
+    [DAMAGE_CHILD_COUNT] = "child count past the end",
+    [DAMAGE_FIRST_CHILD] = "first child past the end",
+    [DAMAGE_TEXT]        = "text past strings",
+    [DAMAGE_SYMBOL_TEXT] = "symbol text past its section",
+    [DAMAGE_NODE_COUNT]  = "huge node count",
+    [DAMAGE_KIND]        = "unknown node kind",
+    [DAMAGE_TRUNCATED]   = "truncated file",
+};
+
+void patch(long at, const void* data, size_t size) {
+    FILE* f = fopen(IMAGE_PATH, "r+b");
+    assert(f && "Image was not written");
+    fseek(f, at, SEEK_SET);
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+void damage_image(Damage d) {
+    DtAstImageHeader h;
+    FILE* f = fopen(IMAGE_PATH, "rb");
+    assert(f && "Image was not written");
+    const bool read = fread(&h, sizeof(h), 1, f) == 1;
+    fclose(f);
+    assert(read && "Image is too short");
+
+    const unsigned int       zero = 0, two = 2, big = 0xFFFFFFF0u;
+    const unsigned long long huge = 1ull << 62;
+    const unsigned char      kind = 200;
+    switch(d) {
+        case DAMAGE_CYCLE:
+            patch(h.sections[DT_AST_SECTION_FIRST_CHILD].offset + sizeof(unsigned int), &zero, sizeof(zero));
+            patch(h.sections[DT_AST_SECTION_CHILD_COUNT].offset + sizeof(unsigned int), &two, sizeof(two));
+            break;
+        case DAMAGE_CHILD_COUNT:
+            patch(h.sections[DT_AST_SECTION_CHILD_COUNT].offset, &big, sizeof(big));
+            break;
+        case DAMAGE_FIRST_CHILD:
+            patch(h.sections[DT_AST_SECTION_FIRST_CHILD].offset, &big, sizeof(big));
+            break;
+        case DAMAGE_TEXT:
+            loop(i, h.node_count)
+                patch(h.sections[DT_AST_SECTION_TEXT].offset + i * sizeof(big), &big, sizeof(big));
+            break;
+        case DAMAGE_SYMBOL_TEXT:
+            patch(h.sections[DT_AST_SECTION_SYMBOLS].offset, &big, sizeof(big));
+            break;
+        case DAMAGE_NODE_COUNT:
+            patch(offsetof(DtAstImageHeader, node_count), &huge, sizeof(huge));
+            break;
+        case DAMAGE_KIND:
+            patch(h.sections[DT_AST_SECTION_KINDS].offset + 1, &kind, sizeof(kind));
+            break;
+        case DAMAGE_TRUNCATED:
+            f = fopen(IMAGE_PATH, "wb");
+            assert(f && "Failed to truncate image");
+            fwrite(&h, sizeof(h) / 2, 1, f);
+            fclose(f);
+            break;
+        default: break;
+    }
+}
+
+// false if image of `file` did not give the same tree and value
+bool check_file(const char* file) {
+    char* source = dt_load_file(file);
+    bool  ok     = true;
+
+    loop(d, DAMAGE_COUNT) {
+        char*     parsed, *loaded;
+        char      parsed_value[256], loaded_value[256];
+        DtRuntime rt = { .file_name = file, .image_path = IMAGE_PATH };
+
+        remove(IMAGE_PATH);
+        lock_and_run(&rt, source, &parsed, parsed_value, sizeof(parsed_value));
+        const bool written = !rt.from_image;
+        dtrt_unlock(&rt);
+
+        damage_image(d);
+        lock_and_run(&rt, source, &loaded, loaded_value, sizeof(loaded_value));
+        const bool from_image = rt.from_image;
+        dtrt_unlock(&rt);
+
+        const char* failure = NULL;
+        if (!written)                                       failure = "image was loaded before it was written";
+        else if (from_image != (d == DAMAGE_NONE))          failure = from_image ? "image was not refused" : "image was not loaded";
+        else if (strcmp(parsed, loaded) != 0)               failure = "trees differ";
+        else if (strcmp(parsed_value, loaded_value) != 0)   failure = "values differ";
+        if (failure) {
+            printf("FAIL %s: %s, %s\n", file, damage_names[d], failure);
+            ok = false;
+        }
+        free(parsed);
+        free(loaded);
+    }
+    if (ok) printf("ok   %s: %d images\n", file, DAMAGE_COUNT);
+
+    remove(IMAGE_PATH);
+    free(source);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int failed = 0;
+    for(int i = 1; i < argc; i++) failed += !check_file(argv[i]);
+    return failed != 0;
+}
@@ -0,0 +1,130 @@
+// parallel lexer and parser against serial ones: each file, and a
+// generated one full of strings and comments, is lexed and parsed with
+// 1, 2 and 8 threads. Tokens, symbols, top level items and printed AST
+// have to be the same. Chunks are made small so that even short inputs
+// are split
+//
+//  usage: parallel file.dt...
+#define TOKENIZER_PARALLEL_MIN_CHUNK 64
+#define PARSER_PARALLEL_MIN_TOKENS   16
+#include "../src/eval.c"
+
+#define GENERATED_FUNCTIONS 200
+
+const size_t thread_counts[] = { 2, 8 };
+
+// functions with strings and comments that look like they could be cut in
+char* generate_source(void) {
+    const size_t capacity = GENERATED_FUNCTIONS * 256;
+    char*  source = malloc(capacity);
+    size_t length = 0;
+    loop(i, GENERATED_FUNCTIONS) {
+        length += snprintf(source + length, capacity - length,
+                "f%d(a int): int {\n"
+                "    /* comment %d with \"quote\" and\n"
+                "       new line */\n"
+                "    s = \"text %d // not a comment /* nor this\"\n"
+                "    // line comment with \"quote\n"
+                "    return a + %d\n"
+                "}\n", (int) i, (int) i, (int) i, (int) i);
+    }
+    return source;
+}
+
+// printed AST, caller frees
+char* ast_text(DtNode* root) {
+    FILE* f = tmpfile();
+    assert(f && "Failed to open temporary file");
+    dtp_print_ast(root, 0, f);
+    const long length = ftell(f);
+    char* text = malloc(length + 1);
+    rewind(f);
+    text[fread(text, 1, length, f)] = 0;
+    fclose(f);
+    return text;
+}
+
+typedef struct {
+    DtStatus    status;
+    DtParser    parser;
+} Lexed;
+
+void lex(Lexed* l, const char* source, size_t threads) {
+    l->status = (DtStatus) { .file_name = "parallel", .source = source };
+    l->parser = (DtParser) { 
+        .lexer      = DtTokenizer_init(source, strlen(source)), 
+        .stat       = &l->status,
+        .threads    = threads,
+    };
+    l->parser.lexer.threads = threads;
+    dtp_parse(&l->parser, 0);
+}
+
+void lexed_free(Lexed* l) {
+    TokenLines_free(&l->status.lines);
+    dtp_free(&l->parser);
+}
+
+// what differs between serial `a` and parallel `b`, NULL if nothing
+const char* difference(const Lexed* a, const Lexed* b) {
+    const DtParser* p = &a->parser, *q = &b->parser;
+    if (p->token_count != q->token_count) return "token count";
+    if (memcmp(p->tokens, q->tokens, (p->token_count + 1) * sizeof(Token))) return "tokens";
+
+    const TokenSymbols* s = &p->lexer.symbols, *t = &q->lexer.symbols;
+    if (s->count != t->count) return "symbol count";
+    loop(i, s->count) {
+        if (s->items[i].length != t->items[i].length || s->items[i].hash != t->items[i].hash ||
+            memcmp(s->items[i].text, t->items[i].text, s->items[i].length)) return "symbols";
+    }
+
+    if (p->items.count != q->items.count) return "item count";
+    loop(i, p->items.count) {
+        if (p->items.items[i].begin != q->items.items[i].begin ||
+            p->items.items[i].end   != q->items.items[i].end) return "item ranges";
+    }
+    if (a->status.abort != b->status.abort) return "parse results";
+
+    char* x = ast_text(p->root);
+    char* y = ast_text(q->root);
+    const bool same = strcmp(x, y) == 0;
+    free(x);
+    free(y);
+    return same ? NULL : "ASTs";
+}
+
+// false if some thread count lexed or parsed `source` differently
+bool check_source(const char* name, const char* source) {
+    Lexed serial;
+    lex(&serial, source, 1);
+
+    bool ok = true;
+    loop(i, DT_ARRLEN(thread_counts)) {
+        Lexed parallel;
+        lex(&parallel, source, thread_counts[i]);
+        const char* failure = difference(&serial, &parallel);
+        if (failure) {
+            printf("FAIL %s: %s differ with %d threads\n", name, failure, (int) thread_counts[i]);
+            ok = false;
+        }
+        lexed_free(&parallel);
+    }
+    if (ok) printf("ok   %s: %d tokens, %d items\n", name, 
+            (int) serial.parser.token_count, (int) serial.parser.items.count);
+    lexed_free(&serial);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int failed = 0;
+    char* generated = generate_source();
+    failed += !check_source("generated", generated);
+    free(generated);
+
+    for(int i = 1; i < argc; i++) {
+        char* source = dt_load_file(argv[i]);
+        failed += !check_source(argv[i], source);
+        free(source);
+    }
+    return failed != 0;
+}
@@ -0,0 +1,176 @@
+// dtp_reparse against a full parse: random edits are made to each file,
+// after every edit tokens (symbol ids aside), top level items, line index
+// and AST of the reparsed source have to match a fresh dtp_parse of it.
+// Nodes of replaced items are reclaimed early, so both paths of
+// dtp_reparse run, and arena has to stay within bounds
+//
+//  usage: reparse file.dt...
+#include <ctype.h>
+#define PARSER_REPARSE_MIN_DEAD 64
+#include "../src/eval.c"
+
+#define EDITS 200
+
+unsigned int random_state = 1;
+
+// xorshift, same edits every run
+unsigned int random_next(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// printed AST, caller frees
+char* ast_text(DtNode* root) {
+    FILE* f = tmpfile();
+    assert(f && "Failed to open temporary file");
+    dtp_print_ast(root, 0, f);
+    const long length = ftell(f);
+    char* text = malloc(length + 1);
+    rewind(f);
+    text[fread(text, 1, length, f)] = 0;
+    fclose(f);
+    return text;
+}
+
+// bytes [begin, end) of top level item `i`, with whatever follows it
+void item_range(const DtParser* p, size_t i, size_t length, size_t* begin, size_t* end) {
+    *begin = p->tokens[p->items.items[i].begin].offset;
+    *end   = (i + 1 < p->items.count) ? p->tokens[p->items.items[i + 1].begin].offset : length;
+}
+
+// one of: digit of a number changed, whitespace or comment put at line start,
+// top level item removed or copied before another one. new source is
+// returned, caller frees
+char* edit_source(const DtParser* p, const char* source, size_t length, DtEdit* edit, size_t* new_length) {
+    static const char* inserts[] = { " ", "\n", "/* c\n x */", "  // line\n" };
+    char*  result = malloc(2 * length + 64);
+    size_t at     = random_next() % length;
+
+    switch(random_next() % 4) {
+        case 0:
+            // never first digit, `0x` has to stay
+            while(at < length && !(at > 0 && isdigit(source[at - 1]) && isdigit(source[at]))) at++;
+            if (at == length) break;
+            memcpy(result, source, length + 1);
+            result[at]  = '0' + random_next() % 10;
+            *edit       = (DtEdit) { at, at + 1, at + 1 };
+            *new_length = length;
+            return result;
+
+        case 1: {
+            if (p->items.count < 3) break;
+            size_t begin, end;
+            item_range(p, random_next() % p->items.count, length, &begin, &end);
+            memcpy(result, source, begin);
+            memcpy(result + begin, source + end, length - end + 1);
+            *edit       = (DtEdit) { begin, end, begin };
+            *new_length = length - (end - begin);
+            return result;
+        }
+        case 2: {
+            if (!p->items.count) break;
+            size_t begin, end, to, to_end;
+            item_range(p, random_next() % p->items.count, length, &begin, &end);
+            item_range(p, random_next() % p->items.count, length, &to, &to_end);
+            memcpy(result, source, to);
+            memcpy(result + to, source + begin, end - begin);
+            memcpy(result + to + (end - begin), source + to, length - to + 1);
+            *edit       = (DtEdit) { to, to, to + (end - begin) };
+            *new_length = length + (end - begin);
+            return result;
+        }
+        default: break;
+    }
+
+    // after a line that ends with a brace, so it is not inside of a comment
+    while(at < length && !(at > 1 && source[at - 1] == '\n' && strchr("{}", source[at - 2]))) at++;
+    const char*  text = inserts[random_next() % DT_ARRLEN(inserts)];
+    const size_t size = strlen(text);
+    memcpy(result, source, at);
+    memcpy(result + at, text, size);
+    memcpy(result + at + size, source + at, length - at + 1);
+    *edit       = (DtEdit) { at, at, at + size };
+    *new_length = length + size;
+    return result;
+}
+
+// what differs between reparsed `p` and fully parsed `q`, NULL if nothing
+const char* difference(DtParser* p, DtParser* q) {
+    if (p->token_count != q->token_count) return "token count";
+    for(size_t i = 0; i <= q->token_count; i++) {
+        const Token a = p->tokens[i], b = q->tokens[i];
+        if (a.kind != b.kind || a.offset != b.offset || a.length != b.length ||
+            a.flags != b.flags || a.id != b.id) return "token";
+        // symbol ids depend on the order words were interned in
+        if (!(a.flags & TokenFlag_symbol) && a.aux != b.aux) return "token value";
+
+        const TknSlice x = Tokenizer_text(&p->lexer, a), y = Tokenizer_text(&q->lexer, b);
+        if (x.length != y.length || (x.length && memcmp(x.data, y.data, x.length))) return "token text";
+    }
+
+    if (p->items.count != q->items.count) return "item count";
+    loop(i, q->items.count) {
+        if (p->items.items[i].begin != q->items.items[i].begin ||
+            p->items.items[i].end   != q->items.items[i].end) return "item range";
+    }
+
+    const TokenLines* l = &p->stat->lines, *m = &q->stat->lines;
+    if (l->count != m->count || l->indexed != m->indexed ||
+        memcmp(l->items, m->items, m->count * sizeof(*m->items))) return "line index";
+
+    char* a = ast_text(p->root);
+    char* b = ast_text(q->root);
+    const bool same = strcmp(a, b) == 0;
+    free(a);
+    free(b);
+    return same ? NULL : "AST";
+}
+
+// false if reparse of some edit did not match
+bool check_file(const char* file) {
+    char*  source = dt_load_file(file);
+    size_t length = strlen(source);
+    DtStatus status = { .file_name = file, .source = source };
+    DtParser p = { .lexer = DtTokenizer_init(source, length), .stat = &status };
+    dtp_parse(&p, 0);
+
+    const char* failure = NULL;
+    int edit_count = 0;
+    for(; edit_count < EDITS && !failure; edit_count++) {
+        DtEdit edit;
+        size_t new_length;
+        char* edited = edit_source(&p, source, length, &edit, &new_length);
+
+        dtp_reparse(&p, edited, new_length, edit);
+        status.source = edited;
+
+        DtStatus fresh_status = { .file_name = file, .source = edited };
+        DtParser q = { .lexer = DtTokenizer_init(edited, new_length), .stat = &fresh_status };
+        dtp_parse(&q, 0);
+        failure = difference(&p, &q);
+        if (!failure && p.node_count > 2 * q.node_count + 2 * PARSER_REPARSE_MIN_DEAD) 
+            failure = "arena size";
+        TokenLines_free(&fresh_status.lines);
+        dtp_free(&q);
+
+        free(source);
+        source = edited;
+        length = new_length;
+    }
+
+    if (failure) printf("FAIL %s: %s is wrong after edit %d\n", file, failure, edit_count);
+    else         printf("ok   %s: %d edits\n", file, edit_count);
+
+    TokenLines_free(&status.lines);
+    dtp_free(&p);
+    free(source);
+    return !failure;
+}
+
+int main(int argc, char** argv) {
+    int failed = 0;
+    for(int i = 1; i < argc; i++) failed += !check_file(argv[i]);
+    return failed != 0;
+}
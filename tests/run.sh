@@ -0,0 +1,17 @@
+#!/bin/sh
+# builds every test and runs it on tests/programs, nonzero if any failed
+#   CC=clang ./tests/run.sh
+cd "$(dirname "$0")" || exit 1
+CC=${CC:-cc}
+mkdir -p build
+failed=0
+build() {
+	$CC -o build/$1 $1.c -std=c99 -ggdb -pthread || exit 1
+}
+for t in reparse vm_walker parallel image; do
+	build $t
+	./build/$t programs/*.dt || failed=1
+done
+build scope
+./build/scope || failed=1
+exit $failed
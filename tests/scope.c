@@ -0,0 +1,63 @@
+// one function table filled from two parses, symbol ids of their
+// tokenizers overlap, every name still has to find its own function
+//
+//  usage: scope
+#include "../src/eval.c"
+
+typedef struct {
+    DtStatus    status;
+    DtParser    parser;
+    DtNode*     root;
+} Source;
+
+void source_parse(Source* s, const char* text) {
+    s->status = (DtStatus) { .file_name = "scope", .source = text };
+    s->parser = (DtParser) { .lexer = DtTokenizer_init(text, strlen(text)), .stat = &s->status };
+    s->root   = dtp_parse(&s->parser, 0);
+}
+
+void source_free(Source* s) {
+    TokenLines_free(&s->status.lines);
+    dtp_free(&s->parser);
+}
+
+// every function of `root` is found in `table` by its own identifier
+bool all_found(DtScope* table, DtNode* root) {
+    for(DtNode* n = root->children; n; n = n->next) {
+        if (n->kind != NK_FUNCTION_DECL) continue;
+        DtObject* f = dto_scope_ref(table, dte_ident_from_node(n));
+        if (!f || f->value.as_function.entry != n) {
+            printf("FAIL scope: %.*s resolves to %s\n", (int) dtp_node_text(n).length, dtp_node_text(n).data,
+                    f ? "another function" : "nothing");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    Source a, b;
+    source_parse(&a, "main(): int {\n    return f() + 1\n}\nf(): int {\n    return 10\n}\n");
+    source_parse(&b, "g(): int {\n    return 20\n}\nh(): int {\n    return g()\n}\n");
+
+    DtContext ctx = { .functions = dto_scope_init(), .parser = &a.parser };
+    dte_eval_prepass(&ctx, a.root);
+    dte_eval_prepass(&ctx, b.root);
+    dte_resolve(&ctx, a.root);
+
+    bool ok = all_found(&ctx.functions, a.root) && all_found(&ctx.functions, b.root);
+    if (ok) {
+        DtObject entry  = dto_scope_get(&ctx.functions, dte_ident_from_node(a.root->children));
+        DtObject result = dte_eval_function(&ctx, (DtNode*) entry.value.as_function.entry);
+        ok = result.value.type == DT_TYPE_INT && result.value.as_int == 11;
+        printf("%s scope: main of first source gives %d\n", ok ? "ok  " : "FAIL", result.value.as_int);
+    }
+
+    dto_scope_clear(&ctx.functions);
+    arena_reset(&ctx.main_allocator);
+    arena_reset(&ctx.name_allocator);
+    free(ctx.stack);
+    source_free(&a);
+    source_free(&b);
+    return !ok;
+}
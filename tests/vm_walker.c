@@ -0,0 +1,70 @@
+// every program is run by the VM and by the tree walker, with bodies
+// parsed up front and lazily, all have to give the same value, and the
+// one on `// expect: ` line if there is one
+//
+//  usage: vm_walker file.dt...
+#include "../src/runtime.c"
+
+#define EXPECT "// expect: "
+
+// value of `main` as text, vm or walker only
+bool run(const char* file, char* source, bool vm, bool lazy, char* out, size_t cap, char* error, size_t error_cap) {
+    DtRuntime rt = { .file_name = file, .lazy = lazy };
+    if (!dtrt_lock(&rt, source, strlen(source)) || rt.status.abort) {
+        snprintf(error, error_cap, "failed to parse");
+        dtrt_unlock(&rt);
+        return false;
+    }
+    // dtrt_run compiles for the vm, walker runs when it is turned off
+    if (!vm) rt.vm_state = DTRT_VM_UNSUPPORTED;
+
+    DtObject result = dtrt_run(&rt);
+    if (vm && rt.vm_state != DTRT_VM_READY) {
+        snprintf(error, error_cap, "vm%s: %s", lazy ? " (lazy)" : "", rt.vm.error);
+        dtrt_unlock(&rt);
+        return false;
+    }
+    DtSerializeOpt opt = { .spacing = "" };
+    dto_serialize(out, cap, opt, result);
+    snprintf(out + strlen(out), cap - strlen(out), " (type %d)", result.value.type);
+    dtrt_unlock(&rt);
+    return true;
+}
+
+// `value` matches text after EXPECT, true if there is nothing expected
+bool expected(const char* source, const char* value) {
+    if (strncmp(source, EXPECT, strlen(EXPECT)) != 0) return true;
+    source += strlen(EXPECT);
+    const size_t length = strcspn(source, "\n");
+    return length == strcspn(value, " ") && strncmp(source, value, length) == 0;
+}
+
+int main(int argc, char** argv) {
+    int failed = 0;
+    for(int i = 1; i < argc; i++) {
+        char* source = dt_load_file(argv[i]);
+        char  vm[256], walker[256], lazy_vm[256], lazy_walker[256], error[256];
+
+        if (!run(argv[i], source, true,  false, vm,          sizeof(vm),          error, sizeof(error)) ||
+            !run(argv[i], source, false, false, walker,      sizeof(walker),      error, sizeof(error)) ||
+            !run(argv[i], source, true,  true,  lazy_vm,     sizeof(lazy_vm),     error, sizeof(error)) ||
+            !run(argv[i], source, false, true,  lazy_walker, sizeof(lazy_walker), error, sizeof(error))) {
+            printf("FAIL %s: %s\n", argv[i], error);
+            failed++;
+        } else if (strcmp(vm, walker) != 0) {
+            printf("FAIL %s: vm gives %s, walker gives %s\n", argv[i], vm, walker);
+            failed++;
+        } else if (strcmp(lazy_vm, walker) != 0 || strcmp(lazy_walker, walker) != 0) {
+            printf("FAIL %s: lazy vm gives %s, lazy walker gives %s, walker gives %s\n", 
+                    argv[i], lazy_vm, lazy_walker, walker);
+            failed++;
+        } else if (!expected(source, walker)) {
+            printf("FAIL %s: got %s, %.*s\n", argv[i], walker,
+                    (int) strcspn(source, "\n") - 3, source + 3);
+            failed++;
+        } else
+            printf("ok   %s: %s\n", argv[i], walker);
+        free(source);
+    }
+    return failed != 0;
+}